@@ -53,4 +53,6 @@ cmake --build "$BUILD_DIR" --parallel --config Release
 echo -e "${GREEN}Build successful!\nInstalling...${NC}"
 sudo cmake --install "$BUILD_DIR" --config Release
 echo -e "${GREEN}Install successful!${NC}"
+# D-Bus starts the new daemon with the next query
+pkill -x krunner-llm-daemon || true
 kquitapp6 krunner && krunner &
@@ -0,0 +1,119 @@
+#include "llmcache.hpp"
+
+#include <QCryptographicHash>
+
+#include <algorithm>
+
+namespace llm
+{
+
+    c_response_cache::c_response_cache(qsizetype capacity, std::chrono::milliseconds ttl)
+        : m_capacity(capacity), m_ttl(ttl)
+    {
+    }
+
+    auto c_response_cache::make_key(const s_config &config, const QString &prompt) -> QString
+    {
+        return QStringLiteral("%1\x1f%2\x1f%3\x1f%4")
+            .arg(static_cast<int>(config.provider))
+            .arg(config.model)
+            .arg(config.max_tokens)
+            .arg(normalize_prompt(prompt));
+    }
+
+    auto c_response_cache::make_key(const s_config &config, const QList<s_message> &history, const QString &prompt) -> QString
+    {
+        auto key = make_key(config, prompt);
+        if (history.isEmpty())
+        {
+            return key;
+        }
+
+        // Keys outlive the process in the disk cache, so no seeded qHash here
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        for (const auto &message : history)
+        {
+            hash.addData(message.role.toUtf8());
+            hash.addData(QByteArrayView("\x1f"));
+            hash.addData(message.content.toUtf8());
+            hash.addData(QByteArrayView("\x1e"));
+        }
+        return key + QLatin1Char('\x1f') + QString::fromLatin1(hash.result().toHex());
+    }
+
+    auto c_response_cache::normalize_prompt(const QString &prompt) -> QString
+    {
+        // "Convert  5 miles to KM" and "convert 5 miles to km" ask the same thing
+        return prompt.simplified().toCaseFolded();
+    }
+
+    auto c_response_cache::lookup(const QString &key) -> std::optional<QString>
+    {
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            return std::nullopt;
+        }
+
+        auto entry = it.value();
+        if (entry->expires <= t_clock::now())
+        {
+            m_entries.erase(entry);
+            m_index.erase(it);
+            return std::nullopt;
+        }
+
+        m_entries.splice(m_entries.begin(), m_entries, entry);
+        return entry->response;
+    }
+
+    void c_response_cache::insert(const QString &key, const QString &response)
+    {
+        if (m_capacity <= 0)
+        {
+            return;
+        }
+
+        const auto expires = t_clock::now() + m_ttl;
+        if (auto it = m_index.find(key); it != m_index.end())
+        {
+            auto entry = it.value();
+            entry->response = response;
+            entry->expires = expires;
+            m_entries.splice(m_entries.begin(), m_entries, entry);
+            return;
+        }
+
+        m_entries.push_front(s_entry{ .key = key, .response = response, .expires = expires });
+        m_index.insert(key, m_entries.begin());
+        evict_to_capacity();
+    }
+
+    void c_response_cache::clear()
+    {
+        m_entries.clear();
+        m_index.clear();
+    }
+
+    void c_response_cache::set_limits(qsizetype capacity, std::chrono::milliseconds ttl)
+    {
+        m_capacity = capacity;
+        m_ttl = ttl;
+        evict_to_capacity();
+    }
+
+    auto c_response_cache::size() const -> qsizetype
+    {
+        return m_index.size();
+    }
+
+    void c_response_cache::evict_to_capacity()
+    {
+        while (!m_entries.empty() && static_cast<qsizetype>(m_entries.size()) > std::max<qsizetype>(m_capacity, 0))
+        {
+            m_index.remove(m_entries.back().key);
+            m_entries.pop_back();
+        }
+    }
+
+} // namespace llm
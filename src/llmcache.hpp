@@ -0,0 +1,56 @@
+#ifndef LLMCACHE_HPP
+#define LLMCACHE_HPP
+
+#include "llmclient.hpp"
+
+#include <QHash>
+#include <QString>
+
+#include <chrono>
+#include <list>
+#include <optional>
+
+namespace llm
+{
+
+    // Bounded least-recently-used cache of answers, keyed by everything
+    // that influences the reply: provider, model, max_tokens and prompt.
+    class c_response_cache
+    {
+    public:
+        using t_clock = std::chrono::steady_clock;
+
+        c_response_cache(qsizetype capacity, std::chrono::milliseconds ttl);
+
+        [[nodiscard]] static auto make_key(const s_config &config, const QString &prompt) -> QString;
+        // A follow-up is only the same question after the same conversation
+        [[nodiscard]] static auto make_key(const s_config &config, const QList<s_message> &history, const QString &prompt) -> QString;
+        [[nodiscard]] static auto normalize_prompt(const QString &prompt) -> QString;
+
+        [[nodiscard]] auto lookup(const QString &key) -> std::optional<QString>;
+        void insert(const QString &key, const QString &response);
+        void clear();
+
+        void set_limits(qsizetype capacity, std::chrono::milliseconds ttl);
+        [[nodiscard]] auto size() const -> qsizetype;
+
+    private:
+        struct s_entry
+        {
+            QString key;
+            QString response;
+            t_clock::time_point expires;
+        };
+
+        void evict_to_capacity();
+
+        qsizetype m_capacity;
+        std::chrono::milliseconds m_ttl;
+        // Front is the most recently used entry
+        std::list<s_entry> m_entries;
+        QHash<QString, std::list<s_entry>::iterator> m_index;
+    };
+
+} // namespace llm
+
+#endif // LLMCACHE_HPP
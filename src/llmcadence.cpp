@@ -0,0 +1,85 @@
+#include "llmcadence.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace llm
+{
+
+    namespace
+    {
+        // Weight of the newest gap; recent sessions matter more than old ones
+        constexpr double smoothing = 0.1;
+        // Below this many gaps the estimate is noise, so the fallback is used
+        constexpr int min_samples = 8;
+        constexpr double deviations = 2.0;
+    } // namespace
+
+    c_typing_cadence::c_typing_cadence(std::chrono::milliseconds min_delay, std::chrono::milliseconds max_delay, std::chrono::milliseconds fallback)
+    {
+        set_bounds(min_delay, max_delay, fallback);
+    }
+
+    void c_typing_cadence::record_keystroke(t_clock::time_point when)
+    {
+        const auto previous = m_last_keystroke;
+        m_last_keystroke = when;
+        if (!previous.has_value())
+        {
+            return;
+        }
+
+        // Gaps longer than the longest allowed delay are the user thinking or
+        // starting a new query, not typing cadence.
+        const auto gap = std::chrono::duration<double, std::milli>(when - *previous).count();
+        if (gap <= 0.0 || gap > static_cast<double>(m_max_delay.count()))
+        {
+            return;
+        }
+
+        if (m_state.samples == 0)
+        {
+            m_state.mean_ms = gap;
+            m_state.variance_ms = 0.0;
+        }
+        else
+        {
+            const auto diff = gap - m_state.mean_ms;
+            const auto increment = smoothing * diff;
+            m_state.mean_ms += increment;
+            m_state.variance_ms = (1.0 - smoothing) * (m_state.variance_ms + diff * increment);
+        }
+        ++m_state.samples;
+    }
+
+    void c_typing_cadence::set_bounds(std::chrono::milliseconds min_delay, std::chrono::milliseconds max_delay, std::chrono::milliseconds fallback)
+    {
+        m_min_delay = min_delay;
+        m_max_delay = std::max(min_delay, max_delay);
+        m_fallback = fallback;
+    }
+
+    auto c_typing_cadence::delay() const -> std::chrono::milliseconds
+    {
+        if (m_state.samples < min_samples)
+        {
+            return std::clamp(m_fallback, m_min_delay, m_max_delay);
+        }
+
+        const auto estimate = m_state.mean_ms + deviations * std::sqrt(m_state.variance_ms);
+        const auto delay = std::chrono::milliseconds(std::lround(estimate));
+        return std::clamp(delay, m_min_delay, m_max_delay);
+    }
+
+    auto c_typing_cadence::state() const -> s_cadence_state
+    {
+        return m_state;
+    }
+
+    void c_typing_cadence::restore(const s_cadence_state &state)
+    {
+        m_state = state;
+        m_last_keystroke.reset();
+    }
+
+} // namespace llm
@@ -0,0 +1,46 @@
+#ifndef LLMCADENCE_HPP
+#define LLMCADENCE_HPP
+
+#include <chrono>
+#include <optional>
+
+namespace llm
+{
+
+    struct s_cadence_state
+    {
+        double mean_ms{ 0.0 };
+        double variance_ms{ 0.0 };
+        int samples{ 0 };
+    };
+
+    // Learns how fast the user types from the gaps between keystrokes and
+    // derives a debounce delay from it: long enough to ride out the usual
+    // pause between two keystrokes, short enough not to wait for nothing.
+    class c_typing_cadence
+    {
+    public:
+        using t_clock = std::chrono::steady_clock;
+
+        c_typing_cadence(std::chrono::milliseconds min_delay, std::chrono::milliseconds max_delay, std::chrono::milliseconds fallback);
+
+        void record_keystroke(t_clock::time_point when);
+        void set_bounds(std::chrono::milliseconds min_delay, std::chrono::milliseconds max_delay, std::chrono::milliseconds fallback);
+
+        // Mean gap plus a safety margin of two standard deviations, clamped to the bounds
+        [[nodiscard]] auto delay() const -> std::chrono::milliseconds;
+
+        [[nodiscard]] auto state() const -> s_cadence_state;
+        void restore(const s_cadence_state &state);
+
+    private:
+        std::chrono::milliseconds m_min_delay{};
+        std::chrono::milliseconds m_max_delay{};
+        std::chrono::milliseconds m_fallback{};
+        s_cadence_state m_state;
+        std::optional<t_clock::time_point> m_last_keystroke;
+    };
+
+} // namespace llm
+
+#endif // LLMCADENCE_HPP
@@ -1,148 +1,683 @@
 #include "llmclient.hpp"
 
+Q_LOGGING_CATEGORY(LLM_CLIENT, "org.kde.krunner.llm.client", QtInfoMsg)
+
 namespace llm
 {
 
-    c_client::c_client(s_config config) : m_config(std::move(config))
+    namespace
+    {
+        // Appended to every question, earlier turns included, so a session's prefix never changes
+        constexpr auto answer_instruction = QLatin1StringView("\nAnswer in few lines. Preferably 2-3 sentences.");
+        // Anthropic caches no shorter prefix; a breakpoint below it only costs the cache write premium
+        constexpr qsizetype min_cached_tokens = 1024;
+
+        // Follows `path` (see extract_json_string) through the DOM. With `diagnose`,
+        // a missing top-level member or an empty array is reported as an error.
+        auto find_text(const QJsonObject &root, QByteArrayView path, bool diagnose) -> t_result
+        {
+            QJsonValue value = root;
+            QByteArrayView previous;
+            while (!path.isEmpty())
+            {
+                const auto dot = path.indexOf('.');
+                const auto step = dot < 0 ? path : path.first(dot);
+                path = dot < 0 ? QByteArrayView() : path.sliced(dot + 1);
+
+                bool is_index = false;
+                const auto index = step.toLongLong(&is_index);
+                if (is_index)
+                {
+                    const auto array = value.toArray();
+                    if (array.size() <= index)
+                    {
+                        if (!diagnose)
+                        {
+                            return QString();
+                        }
+                        return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Empty %1 array").arg(QString::fromLatin1(previous)) });
+                    }
+                    value = array[index];
+                }
+                else
+                {
+                    const auto object = value.toObject();
+                    const auto key = QString::fromLatin1(step);
+                    if (diagnose && previous.isEmpty() && !object.contains(key))
+                    {
+                        return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Missing '%1' in response").arg(key) });
+                    }
+                    value = object[key];
+                }
+                previous = step;
+            }
+            return value.toString();
+        }
+
+        auto deadline_message(e_error_code code) -> QString
+        {
+            switch (code)
+            {
+            case e_error_code::connect_timeout:
+                return QStringLiteral("Could not connect to the server in time");
+            case e_error_code::first_byte_timeout:
+                return QStringLiteral("The server did not start answering in time");
+            case e_error_code::idle_timeout:
+                return QStringLiteral("The answer stopped arriving");
+            default:
+                return QStringLiteral("Request timed out");
+            }
+        }
+    } // namespace
+
+    c_client::c_client(s_config config, std::shared_ptr<c_connection_pool> pool)
+        : m_config(std::move(config)), m_pool(std::move(pool)), m_traits(&provider_traits(m_config.provider))
+    {
+        if (!m_pool)
+        {
+            m_pool = std::make_shared<c_connection_pool>();
+        }
+        m_reply_context = std::make_unique<QObject>();
+
+        // Quotas are per account, so every client with the same key draws from one budget
+        m_rate_limiter = c_rate_limiter::shared(QStringLiteral("%1/%2").arg(static_cast<int>(m_config.provider)).arg(m_config.apiKey));
+        m_rate_limiter->set_limits(m_config.requests_per_minute, m_config.tokens_per_minute);
+
+        m_metrics = &c_latency_registry::instance().series(QStringLiteral("%1/%2").arg(m_traits->name, m_config.model));
+
+        // The configuration is fixed for the client's lifetime, so requests are assembled once
+        for (const bool stream : { false, true })
+        {
+            m_request_skeletons[stream ? 1 : 0] = make_request(stream);
+            m_payload_skeletons[stream ? 1 : 0] = make_payload_skeleton(stream);
+        }
+    }
+
+    auto c_client::metrics() const -> c_phase_metrics &
     {
-        m_networkManager = std::make_unique<QNetworkAccessManager>();
+        return *m_metrics;
     }
 
-    auto c_client::send_message(const QString &prompt) -> std::expected<QString, s_error>
+    c_client::~c_client()
     {
+        // Deleting the context aborts the outstanding replies parented to it
+        // and drops their callbacks before they can observe a dead client.
+        m_reply_context.reset();
+    }
 
-        auto request = build_request();
-        auto payload = build_payload(prompt);
+    void c_request_handle::s_state::stop()
+    {
+        finished = true;
 
-        QEventLoop loop;
-        QNetworkReply *reply = m_networkManager->post(request, payload);
+        // stop() may run from inside a timer's own timeout, so never delete them directly
+        for (const auto &timer : { deadline, hedge_timer })
+        {
+            if (timer)
+            {
+                timer->stop();
+                timer->deleteLater();
+            }
+        }
+
+        // abort() emits finished() synchronously; the reply handlers see `finished` and bail out
+        const auto outstanding = replies;
+        for (const auto &reply : outstanding)
+        {
+            if (reply)
+            {
+                reply->abort();
+            }
+        }
+    }
+
+    void c_request_handle::cancel()
+    {
+        if (!m_state || m_state->finished)
+        {
+            return;
+        }
+
+        m_state->stop();
+    }
 
-        QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    auto c_request_handle::is_active() const -> bool
+    {
+        return m_state && !m_state->finished;
+    }
+
+    auto c_client::send_message(const QString &prompt) -> t_result
+    {
+        QEventLoop loop;
+        std::optional<t_result> result;
 
-        QTimer::singleShot(m_config.timeout_ms, &loop, [&loop, reply]()
+        send_message_async(prompt, [&loop, &result](t_result reply_result)
                            {
-                           reply->abort();
+                           result = std::move(reply_result);
                            loop.quit(); });
 
-        loop.exec();
+        if (!result.has_value())
+        {
+            loop.exec();
+        }
+
+        return std::move(*result);
+    }
+
+    auto c_client::send_message_async(const QString &prompt, t_result_callback on_finished) -> c_request_handle
+    {
+        return start_request({}, prompt, nullptr, std::move(on_finished));
+    }
+
+    auto c_client::send_message_async(const QList<s_message> &history, const QString &prompt, t_result_callback on_finished) -> c_request_handle
+    {
+        return start_request(history, prompt, nullptr, std::move(on_finished));
+    }
+
+    auto c_client::send_message_stream(const QString &prompt, t_chunk_callback on_chunk, t_result_callback on_finished) -> c_request_handle
+    {
+        return start_request({}, prompt, std::move(on_chunk), std::move(on_finished));
+    }
+
+    auto c_client::send_message_stream(const QList<s_message> &history, const QString &prompt, t_chunk_callback on_chunk, t_result_callback on_finished) -> c_request_handle
+    {
+        return start_request(history, prompt, std::move(on_chunk), std::move(on_finished));
+    }
+
+    void c_client::set_hedging(std::optional<s_hedge_config> hedge)
+    {
+        m_hedge = std::move(hedge);
+        m_hedge_client.reset();
+        if (m_hedge.has_value())
+        {
+            m_hedge_client = std::make_unique<c_client>(m_hedge->secondary, m_pool);
+        }
+    }
 
-        if (reply->error() == QNetworkReply::TimeoutError)
+    auto c_client::reconfigure(const s_config &config) -> bool
+    {
+        if (config.provider != m_config.provider || config.apiKey != m_config.apiKey || config.model != m_config.model || config.base_url != m_config.base_url)
         {
-            reply->deleteLater();
-            return std::unexpected(s_error{ .code = e_error_code::timeout, .message = QStringLiteral("Request timed out") });
+            return false;
         }
 
-        if (reply->error() != QNetworkReply::NoError)
+        // Requests already sent keep the deadline and payload they were started with
+        m_config = config;
+        m_rate_limiter->set_limits(m_config.requests_per_minute, m_config.tokens_per_minute);
+        for (const bool stream : { false, true })
         {
-            auto error_message = reply->errorString();
-            reply->deleteLater();
-            return std::unexpected(s_error{ .code = e_error_code::network_error, .message = error_message });
+            m_payload_skeletons[stream ? 1 : 0] = make_payload_skeleton(stream);
         }
+        return true;
+    }
 
-        auto response_data = reply->readAll();
-        reply->deleteLater();
+    auto c_client::start_request(const QList<s_message> &history, const QString &prompt, t_chunk_callback on_chunk, t_result_callback on_finished) -> c_request_handle
+    {
+        c_request_handle handle;
+        handle.m_state = std::make_shared<c_request_handle::s_state>();
+        auto state = handle.m_state;
+        state->history = history;
+        state->on_chunk = std::move(on_chunk);
+        state->on_finished = std::move(on_finished);
+        ++m_requests;
+
+        // One deadline covers the primary and any hedge
+        auto *deadline = new QTimer(m_reply_context.get());
+        deadline->setSingleShot(true);
+        QObject::connect(deadline, &QTimer::timeout, m_reply_context.get(), [state]()
+                         {
+                         state->timed_out = true;
+                         const auto outstanding = state->replies;
+                         for (const auto &reply : outstanding)
+                         {
+                             if (reply)
+                             {
+                                 reply->abort();
+                             }
+                         }
+
+                         // A lane waiting for its retry has no reply to abort
+                         if (!state->finished)
+                         {
+                             complete(state, std::unexpected(s_error{ .code = e_error_code::timeout, .message = QStringLiteral("Request timed out") }));
+                         } });
+        deadline->start(m_config.timeout_ms);
+        state->deadline = deadline;
+        state->deadline_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_config.timeout_ms);
+
+        launch(state, prompt);
+        if (m_hedge_client)
+        {
+            arm_hedge(state, prompt);
+        }
 
-        return parse_response(response_data);
+        return handle;
     }
 
-    auto c_client::build_request() const -> QNetworkRequest
+    void c_client::launch(const t_state &state, const QString &prompt, int attempt)
     {
-        QNetworkRequest request;
-        request.setUrl(QUrl(get_endpoint()));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/json"));
+        if (attempt == 0)
+        {
+            ++state->pending;
+        }
 
-        switch (m_config.provider)
+#if QT_VERSION < QT_VERSION_CHECK(6, 8, 0)
+        // Without FullLocalServerNameAttribute the request, key included, would go to localhost:80
+        if (auto socket = local_socket())
         {
-        case e_provider::OpenAI:
-        case e_provider::OpenRouter:
-        case e_provider::Groq:
-            request.setRawHeader("Authorization",
-                                 QStringLiteral("Bearer %1").arg(m_config.apiKey).toUtf8());
-            break;
-        case e_provider::Anthropic:
-            request.setRawHeader("x-api-key", m_config.apiKey.toUtf8());
-            request.setRawHeader("anthropic-version", "2023-06-01");
-            break;
-        case e_provider::Gemini:
-            request.setRawHeader("x-goog-api-key", m_config.apiKey.toUtf8());
-            break;
+            qCWarning(LLM_CLIENT) << "Unix socket transport for" << *socket << "needs Qt 6.8 or newer";
+            QTimer::singleShot(0, m_reply_context.get(), [state]()
+                               { fail_lane(state, s_error{ .code = e_error_code::network_error, .message = QStringLiteral("Unix socket base URLs need Qt 6.8 or newer") }); });
+            return;
         }
+#endif
 
-        return request;
+        // Roughly four characters per token, plus the whole completion budget
+        auto characters = prompt.size();
+        for (const auto &message : std::as_const(state->history))
+        {
+            characters += message.content.size();
+        }
+        const auto tokens = static_cast<int>(characters / 4) + m_config.max_tokens;
+        const auto wait = m_rate_limiter->reserve(tokens);
+        if (wait <= std::chrono::milliseconds::zero())
+        {
+            post(state, prompt, attempt);
+            return;
+        }
+
+        // Queue locally rather than earn a 429, unless the wait outlives the request.
+        // Failing is deferred so callers never see their callback before the handle.
+        const bool too_late = std::chrono::steady_clock::now() + wait >= state->deadline_at;
+        QTimer::singleShot(too_late ? std::chrono::milliseconds::zero() : wait, m_reply_context.get(), [this, state, prompt, attempt, too_late]()
+                           {
+                           if (too_late)
+                           {
+                               fail_lane(state, s_error{ .code = e_error_code::rate_limited, .message = QStringLiteral("Local rate limit exceeded") });
+                           }
+                           else if (!state->finished)
+                           {
+                               post(state, prompt, attempt);
+                           } });
     }
 
-    auto c_client::build_payload(const QString &prompt_text) const -> QByteArray
+    void c_client::post(const t_state &state, const QString &prompt, int attempt)
     {
-        QJsonObject json;
+        const bool stream = static_cast<bool>(state->on_chunk);
+        const auto build_started = std::chrono::steady_clock::now();
+        auto request = build_request(stream);
+        auto payload = build_payload(state->history, prompt, stream);
+        auto timeline = std::make_shared<s_timeline>();
+        timeline->posted = std::chrono::steady_clock::now();
+        m_metrics->record(e_phase::build, timeline->posted - build_started);
+
+        QNetworkReply *reply = m_pool->post(request, payload);
+        reply->setParent(m_reply_context.get());
+        state->replies.append(reply);
+        auto watchdog = std::make_shared<s_watchdog>();
+        arm_watchdog(*reply, watchdog, stream);
+
+        // A reused connection skips socketStartedConnecting altogether
+        QObject::connect(reply, &QNetworkReply::socketStartedConnecting, m_reply_context.get(), [timeline]()
+                         { timeline->connecting = std::chrono::steady_clock::now(); }, Qt::SingleShotConnection);
+        QObject::connect(reply, &QNetworkReply::requestSent, m_reply_context.get(), [timeline]()
+                         { timeline->sent = std::chrono::steady_clock::now(); }, Qt::SingleShotConnection);
+        QObject::connect(reply, &QNetworkReply::metaDataChanged, m_reply_context.get(), [this, state, timeline]()
+                         {
+                         state->first_byte = true;
+                         timeline->first_byte = std::chrono::steady_clock::now();
+                         m_first_byte_latency.add(std::chrono::duration_cast<std::chrono::milliseconds>(*timeline->first_byte - timeline->posted)); }, Qt::SingleShotConnection);
+
+        std::shared_ptr<s_stream_state> stream_state;
+        if (stream)
+        {
+            stream_state = std::make_shared<s_stream_state>();
+            QObject::connect(reply, &QNetworkReply::readyRead, m_reply_context.get(), [this, state, reply, stream_state]()
+                             {
+                             if (!state->finished && (!state->winner || state->winner == reply))
+                             {
+                                 consume_stream(*reply, *stream_state, state);
+                             } });
+        }
 
-        QString prompt = prompt_text + QStringLiteral("\nAnswer in few lines. Preferably 2-3 sentences.");
+        QObject::connect(reply, &QNetworkReply::finished, m_reply_context.get(), [this, state, prompt, attempt, reply, stream_state, timeline, watchdog]()
+                         {
+                         // Detach first: the callbacks may destroy this client
+                         reply->setParent(nullptr);
+                         reply->deleteLater();
+                         state->replies.removeAll(reply);
+                         if (reply->error() == QNetworkReply::NoError)
+                         {
+                             record_timeline(*timeline, std::chrono::steady_clock::now());
+                         }
+
+                         // Cancelled, already answered by another reply, or a streaming loser
+                         if (state->finished || (state->winner && state->winner != reply))
+                         {
+                             --state->pending;
+                             return;
+                         }
+
+                         // Overloaded or throttled before any text arrived: try again on the same lane
+                         if (auto delay = retry_delay(*reply, state, attempt))
+                         {
+                             QTimer::singleShot(*delay, m_reply_context.get(), [this, state, prompt, attempt]()
+                                                {
+                                                if (!state->finished)
+                                                {
+                                                    launch(state, prompt, attempt + 1);
+                                                } });
+                             return;
+                         }
+
+                         // The overall budget outranks the deadline of the phase it cut short
+                         std::optional<e_error_code> expired;
+                         if (state->timed_out)
+                         {
+                             expired = e_error_code::timeout;
+                         }
+                         else if (watchdog->expired)
+                         {
+                             expired = watchdog->phase;
+                         }
+
+                         const auto parse_started = std::chrono::steady_clock::now();
+                         auto result = stream_state ? finish_stream(*reply, *stream_state, state, expired)
+                                                    : read_reply(*reply, expired);
+                         m_metrics->record(e_phase::parse, std::chrono::steady_clock::now() - parse_started);
+                         if (state->finished)
+                         {
+                             return;
+                         }
+
+                         if (result.has_value() || state->winner == reply)
+                         {
+                             complete(state, std::move(result));
+                             return;
+                         }
+
+                         // The other lane may still answer; report this error only if it fails too
+                         fail_lane(state, result.error()); });
+    }
 
-        switch (m_config.provider)
+    void c_client::arm_watchdog(QNetworkReply &reply, const std::shared_ptr<s_watchdog> &watchdog, bool stream) const
+    {
+        auto *timer = new QTimer(&reply);
+        timer->setSingleShot(true);
+        watchdog->timer = timer;
+        QObject::connect(timer, &QTimer::timeout, &reply, [watchdog, &reply]()
+                         {
+                         watchdog->expired = true;
+                         reply.abort(); });
+
+        const auto enter = [watchdog](e_error_code phase, int timeout_ms)
         {
-        case e_provider::OpenAI:
-        case e_provider::OpenRouter:
-        case e_provider::Groq:
+            watchdog->phase = phase;
+            if (!watchdog->timer)
+            {
+                return;
+            }
+            if (timeout_ms > 0)
+            {
+                watchdog->timer->start(timeout_ms);
+            }
+            else
+            {
+                watchdog->timer->stop();
+            }
+        };
+
+        // Connecting runs from the socket's first move until the request is on the wire, so a
+        // dead endpoint fails fast while a request queued behind others in QNAM does not.
+        // A reused connection skips the phase.
+        const auto connect_ms = m_config.connect_timeout_ms;
+        QObject::connect(&reply, &QNetworkReply::socketStartedConnecting, &reply, [enter, connect_ms]()
+                         { enter(e_error_code::connect_timeout, connect_ms); }, Qt::SingleShotConnection);
+        const auto first_byte_ms = stream ? m_config.first_byte_timeout_ms : 0;
+        QObject::connect(&reply, &QNetworkReply::requestSent, &reply, [enter, first_byte_ms]()
+                         { enter(e_error_code::first_byte_timeout, first_byte_ms); }, Qt::SingleShotConnection);
+
+        // After the headers only pauses count, however long the whole answer takes
+        const auto idle_ms = m_config.idle_timeout_ms;
+        QObject::connect(&reply, &QNetworkReply::metaDataChanged, &reply, [enter, idle_ms]()
+                         { enter(e_error_code::idle_timeout, idle_ms); }, Qt::SingleShotConnection);
+        QObject::connect(&reply, &QNetworkReply::readyRead, &reply, [enter, watchdog, idle_ms]()
+                         {
+                         if (watchdog->phase == e_error_code::idle_timeout)
+                         {
+                             enter(e_error_code::idle_timeout, idle_ms);
+                         } });
+    }
+
+    void c_client::record_timeline(const s_timeline &timeline, std::chrono::steady_clock::time_point finished) const
+    {
+        if (!timeline.sent || !timeline.first_byte)
         {
-            QJsonArray messages;
-            QJsonObject message;
-            message[QStringLiteral("role")] = QStringLiteral("user");
-            message[QStringLiteral("content")] = prompt;
-            messages.append(message);
+            return;
+        }
 
-            json[QStringLiteral("model")] = m_config.model;
-            json[QStringLiteral("messages")] = messages;
-            json[QStringLiteral("max_tokens")] = m_config.max_tokens;
-            break;
+        const auto handshake_started = timeline.connecting.value_or(*timeline.sent);
+        m_metrics->record(e_phase::queue, handshake_started - timeline.posted);
+        if (timeline.connecting)
+        {
+            m_metrics->record(e_phase::connect, *timeline.sent - *timeline.connecting);
+        }
+        m_metrics->record(e_phase::first_byte, *timeline.first_byte - *timeline.sent);
+        m_metrics->record(e_phase::transfer, finished - *timeline.first_byte);
+    }
+
+    auto c_client::retry_delay(QNetworkReply &reply, const t_state &state, int attempt) const -> std::optional<std::chrono::milliseconds>
+    {
+        constexpr int max_attempts = 3;
+
+        const auto status = reply.attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        const auto hint = parse_rate_limit_headers(reply.rawHeaderPairs());
+        const auto now = std::chrono::steady_clock::now();
+
+        // Exhausted quotas hold back every client of this account, retried or not
+        const auto server_wait = std::max(hint.retry_after.value_or(std::chrono::milliseconds::zero()),
+                                          hint.quota_reset.value_or(std::chrono::milliseconds::zero()));
+        if (status == 429 || hint.quota_reset.has_value())
+        {
+            m_rate_limiter->block_until(now + server_wait);
         }
-        case e_provider::Anthropic:
+
+        // 529 is Anthropic's "overloaded"
+        const bool retryable = status == 429 || status == 500 || status == 502 || status == 503 || status == 504 || status == 529;
+        if (!retryable || state->timed_out || state->winner == &reply || attempt + 1 >= max_attempts)
         {
-            QJsonArray messages;
-            QJsonObject message;
-            message[QStringLiteral("role")] = QStringLiteral("user");
-            message[QStringLiteral("content")] = prompt;
-            messages.append(message);
+            return std::nullopt;
+        }
 
-            json[QStringLiteral("model")] = m_config.model;
-            json[QStringLiteral("messages")] = messages;
-            json[QStringLiteral("max_tokens")] = m_config.max_tokens;
-            break;
+        const auto delay = std::max(backoff_delay(attempt), server_wait);
+        if (now + delay >= state->deadline_at)
+        {
+            return std::nullopt;
         }
-        case e_provider::Gemini:
+        return delay;
+    }
+
+    void c_client::fail_lane(const t_state &state, s_error error)
+    {
+        --state->pending;
+        if (state->finished)
         {
-            QJsonArray parts;
-            QJsonObject part;
-            part[QStringLiteral("text")] = prompt;
-            parts.append(part);
+            return;
+        }
 
-            QJsonArray contents;
-            QJsonObject content;
-            content[QStringLiteral("parts")] = parts;
-            contents.append(content);
+        if (state->pending > 0)
+        {
+            state->error = std::move(error);
+            return;
+        }
 
-            json[QStringLiteral("contents")] = contents;
+        // Report the error of the lane that failed first
+        complete(state, std::unexpected(state->error.value_or(std::move(error))));
+    }
 
-            QJsonObject generation_config;
-            generation_config[QStringLiteral("maxOutputTokens")] = m_config.max_tokens;
-            json[QStringLiteral("generationConfig")] = generation_config;
-            break;
+    void c_client::arm_hedge(const t_state &state, const QString &prompt)
+    {
+        auto *hedge_timer = new QTimer(m_reply_context.get());
+        hedge_timer->setSingleShot(true);
+        QObject::connect(hedge_timer, &QTimer::timeout, m_reply_context.get(), [this, state, prompt, hedge_timer]()
+                         {
+                         hedge_timer->deleteLater();
+                         if (!m_hedge_client || state->finished || state->first_byte || state->pending == 0)
+                         {
+                             return;
+                         }
+
+                         // Stay within the duplication budget
+                         if (static_cast<double>(m_hedges + 1) > m_hedge->budget * static_cast<double>(m_requests))
+                         {
+                             return;
+                         }
+
+                         ++m_hedges;
+                         m_hedge_client->launch(state, prompt); });
+        hedge_timer->start(hedge_delay());
+        state->hedge_timer = hedge_timer;
+    }
+
+    auto c_client::hedge_delay() const -> std::chrono::milliseconds
+    {
+        // Too few samples make the tail percentile meaningless
+        constexpr std::size_t min_samples = 16;
+        if (m_first_byte_latency.size() < min_samples)
+        {
+            return m_hedge->initial_delay;
+        }
+        return m_first_byte_latency.percentile(m_hedge->percentile);
+    }
+
+    void c_client::complete(const t_state &state, t_result result)
+    {
+        auto on_finished = std::move(state->on_finished);
+        // Stops the deadline and aborts the losing reply, if any
+        state->stop();
+        on_finished(std::move(result));
+    }
+
+    void c_client::consume_stream(QNetworkReply &reply, s_stream_state &stream, const t_state &state) const
+    {
+        const auto events = stream.parser.feed(reply.readAll());
+        for (const auto &event : events)
+        {
+            auto chunk = parse_stream_event(event);
+            if (!chunk.has_value())
+            {
+                stream.error = chunk.error();
+                continue;
+            }
+            if (chunk->isEmpty())
+            {
+                continue;
+            }
+
+            // The first reply to stream text wins; a hedged duplicate is cancelled
+            if (!state->winner)
+            {
+                state->winner = &reply;
+                const auto outstanding = state->replies;
+                for (const auto &other : outstanding)
+                {
+                    if (other && other != &reply)
+                    {
+                        other->abort();
+                    }
+                }
+            }
+
+            stream.text += *chunk;
+            state->on_chunk(*chunk);
+
+            // The chunk callback may have cancelled the request
+            if (state->finished)
+            {
+                return;
+            }
+        }
+    }
+
+    auto c_client::finish_stream(QNetworkReply &reply, s_stream_state &stream, const t_state &state, std::optional<e_error_code> expired) const -> t_result
+    {
+        consume_stream(reply, stream, state);
+
+        if (auto error = reply_error(reply, expired))
+        {
+            return std::unexpected(*error);
+        }
+        if (stream.error.has_value())
+        {
+            return std::unexpected(*stream.error);
         }
+        if (stream.text.isEmpty())
+        {
+            return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Empty response content") });
+        }
+        return stream.text;
+    }
+
+    auto c_client::read_reply(QNetworkReply &reply, std::optional<e_error_code> expired) const -> t_result
+    {
+        if (auto error = reply_error(reply, expired))
+        {
+            return std::unexpected(*error);
         }
 
-        return QJsonDocument(json).toJson(QJsonDocument::Compact);
+        return parse_response(reply.readAll());
     }
 
-    auto c_client::parse_response(const QByteArray &data) const -> std::expected<QString, s_error>
+    auto c_client::reply_error(QNetworkReply &reply, std::optional<e_error_code> expired) const -> std::optional<s_error>
     {
+        // An abort from our own timers surfaces as OperationCanceledError
+        if (expired.has_value())
+        {
+            return s_error{ .code = *expired, .message = deadline_message(*expired) };
+        }
+        if (reply.error() == QNetworkReply::TimeoutError)
+        {
+            return s_error{ .code = e_error_code::timeout, .message = QStringLiteral("Request timed out") };
+        }
 
-        auto doc = QJsonDocument::fromJson(data);
+        const auto status = reply.attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (status == 429)
+        {
+            return s_error{ .code = e_error_code::rate_limited, .message = reply.errorString() };
+        }
+        if (status == 401 || status == 403)
+        {
+            return s_error{ .code = e_error_code::invalid_api_key, .message = reply.errorString() };
+        }
+
+        if (reply.error() != QNetworkReply::NoError)
+        {
+            return s_error{ .code = e_error_code::network_error, .message = reply.errorString() };
+        }
+
+        return std::nullopt;
+    }
+
+    auto c_client::parse_stream_event(const s_sse_event &event) const -> t_result
+    {
+        if (event.data == "[DONE]")
+        {
+            return QString();
+        }
+
+        // Text deltas are by far the most frequent events; only the rest needs the DOM
+        if (auto text = extract_json_string(event.data, m_traits->stream_text_path); text && !text->isEmpty())
+        {
+            return *std::move(text);
+        }
+
+        auto doc = QJsonDocument::fromJson(event.data);
         if (doc.isNull() || !doc.isObject())
         {
-            return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Invalid JSON response") });
+            return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Invalid JSON in stream event") });
         }
 
         auto obj = doc.object();
 
-        // Check for error response
         if (obj.contains(QStringLiteral("error")))
         {
             auto error_obj = obj[QStringLiteral("error")].toObject();
@@ -150,76 +685,201 @@ namespace llm
             return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = error_msg });
         }
 
-        QString content;
+        // Bookkeeping events (role, ping, stop reasons) simply have no text
+        return find_text(obj, m_traits->stream_text_path, false);
+    }
+
+    auto c_client::build_request(bool stream) const -> QNetworkRequest
+    {
+        return m_request_skeletons[stream ? 1 : 0];
+    }
+
+    auto c_client::build_payload(const QString &prompt, bool stream) const -> QByteArray
+    {
+        // Only the prompt changes between calls; everything around it was serialized once
+        const auto &skeleton = m_payload_skeletons[stream ? 1 : 0];
+        QByteArray payload;
+        payload.reserve(skeleton.prefix.size() + prompt.size() * 2 + skeleton.suffix.size());
+        payload.append(skeleton.prefix);
+        append_json_escaped(payload, prompt);
+        payload.append(skeleton.suffix);
+        return payload;
+    }
+
+    auto c_client::build_payload(const QList<s_message> &history, const QString &prompt, bool stream) const -> QByteArray
+    {
+        if (history.isEmpty())
+        {
+            return build_payload(prompt, stream);
+        }
+
+        // Follow-ups are rare enough to be serialized from scratch
+        auto messages = history;
+        messages.append(s_message{ .role = QStringLiteral("user"), .content = prompt });
+        return QJsonDocument(make_payload(messages, stream)).toJson(QJsonDocument::Compact);
+    }
+
+    auto c_client::make_request(bool stream) const -> QNetworkRequest
+    {
+        QNetworkRequest request;
+        request.setUrl(QUrl(get_endpoint(stream)));
+        request.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/json"));
+        if (stream)
+        {
+            request.setRawHeader("Accept", "text/event-stream");
+        }
+
+        // Local servers usually run without a key
+        if (!m_config.apiKey.isEmpty())
+        {
+            request.setRawHeader(m_traits->auth_header.toByteArray(), m_traits->auth_prefix.toByteArray() + m_config.apiKey.toUtf8());
+        }
+        if (!m_traits->version_header.isEmpty())
+        {
+            request.setRawHeader(m_traits->version_header.toByteArray(), m_traits->version.toByteArray());
+        }
 
-        switch (m_config.provider)
+#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
+        // The URL keeps its http scheme; the connection goes to the socket instead
+        if (auto socket = local_socket())
         {
-        case e_provider::OpenAI:
-        case e_provider::OpenRouter:
-        case e_provider::Groq:
+            request.setAttribute(QNetworkRequest::FullLocalServerNameAttribute, *socket);
+        }
+#endif
+
+        return request;
+    }
+
+    auto c_client::make_payload(const QList<s_message> &messages, bool stream) const -> QJsonObject
+    {
+        // The two last questions carry the cache breakpoints: the newest lets the next
+        // follow-up read everything up to here, the one before reads what this request wrote
+        qsizetype breakpoints = 0;
+        const auto cache_breakpoint = [&](qsizetype index)
         {
-            if (!obj.contains(QStringLiteral("choices")))
+            if (!m_traits->cache_breakpoints || messages.size() < 2 || messages[index].role != QStringLiteral("user") || breakpoints == 2)
             {
-                return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Missing 'choices' in response") });
+                return false;
             }
 
-            auto choices = obj[QStringLiteral("choices")].toArray();
-            if (choices.isEmpty())
+            // Roughly four characters to a token
+            qsizetype characters = 0;
+            for (qsizetype earlier = 0; earlier <= index; ++earlier)
             {
-                return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Empty choices array") });
+                characters += messages[earlier].content.size() + answer_instruction.size();
             }
-
-            auto first_choice = choices[0].toObject();
-            auto message = first_choice[QStringLiteral("message")].toObject();
-            content = message[QStringLiteral("content")].toString();
-            break;
-        }
-        case e_provider::Anthropic:
-        {
-            if (!obj.contains(QStringLiteral("content")))
+            if (characters / 4 < min_cached_tokens)
             {
-                return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Missing 'content' in response") });
+                return false;
             }
+            ++breakpoints;
+            return true;
+        };
 
-            auto content_array = obj[QStringLiteral("content")].toArray();
-            if (content_array.isEmpty())
+        QJsonObject json;
+        switch (m_traits->layout)
+        {
+        case e_payload_layout::chat_messages:
+        {
+            QJsonArray array;
+            for (auto index = messages.size() - 1; index >= 0; --index)
             {
-                return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Empty content array") });
+                const auto &message = messages[index];
+                const auto text = message.role == QStringLiteral("user") ? message.content + answer_instruction : message.content;
+
+                QJsonObject entry;
+                entry[QStringLiteral("role")] = message.role;
+                if (cache_breakpoint(index))
+                {
+                    QJsonObject block;
+                    block[QStringLiteral("type")] = QStringLiteral("text");
+                    block[QStringLiteral("text")] = text;
+                    block[QStringLiteral("cache_control")] = QJsonObject{ { QStringLiteral("type"), QStringLiteral("ephemeral") } };
+                    entry[QStringLiteral("content")] = QJsonArray{ block };
+                }
+                else
+                {
+                    entry[QStringLiteral("content")] = text;
+                }
+                array.prepend(entry);
             }
 
-            auto first_content = content_array[0].toObject();
-            content = first_content[QStringLiteral("text")].toString();
+            json[QStringLiteral("model")] = m_config.model;
+            json[QStringLiteral("messages")] = array;
+            json[QStringLiteral("max_tokens")] = m_config.max_tokens;
             break;
         }
-        case e_provider::Gemini:
+        case e_payload_layout::gemini_contents:
         {
-            if (!obj.contains(QStringLiteral("candidates")))
+            QJsonArray contents;
+            for (const auto &message : messages)
             {
-                return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Missing 'candidates' in response") });
+                const bool user = message.role == QStringLiteral("user");
+                QJsonObject part;
+                part[QStringLiteral("text")] = user ? message.content + answer_instruction : message.content;
+
+                QJsonObject content;
+                // Gemini calls the assistant "model"; a lone question needs no role
+                if (messages.size() > 1)
+                {
+                    content[QStringLiteral("role")] = user ? QStringLiteral("user") : QStringLiteral("model");
+                }
+                content[QStringLiteral("parts")] = QJsonArray{ part };
+                contents.append(content);
             }
 
-            auto candidates = obj[QStringLiteral("candidates")].toArray();
-            if (candidates.isEmpty())
-            {
-                return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Empty candidates array") });
-            }
+            json[QStringLiteral("contents")] = contents;
 
-            auto first_candidate = candidates[0].toObject();
-            auto content_obj = first_candidate[QStringLiteral("content")].toObject();
-            auto parts = content_obj[QStringLiteral("parts")].toArray();
+            QJsonObject generation_config;
+            generation_config[QStringLiteral("maxOutputTokens")] = m_config.max_tokens;
+            json[QStringLiteral("generationConfig")] = generation_config;
+            break;
+        }
+        }
+        if (stream && m_traits->stream_flag)
+        {
+            json[QStringLiteral("stream")] = true;
+        }
+        return json;
+    }
 
-            if (parts.isEmpty())
-            {
-                return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Empty parts array") });
-            }
+    auto c_client::make_payload_skeleton(bool stream) const -> s_payload_skeleton
+    {
+        // Serialize the payload once around a marker, then split it where the prompt goes
+        const auto marker = QStringLiteral("\x1fprompt\x1f");
+        const auto serialized = QJsonDocument(make_payload({ s_message{ .role = QStringLiteral("user"), .content = marker } }, stream)).toJson(QJsonDocument::Compact);
+        QByteArray escaped_marker;
+        append_json_escaped(escaped_marker, marker);
+        const auto split = serialized.indexOf(escaped_marker);
+        return s_payload_skeleton{ .prefix = serialized.left(split), .suffix = serialized.mid(split + escaped_marker.size()) };
+    }
 
-            auto first_part = parts[0].toObject();
-            content = first_part[QStringLiteral("text")].toString();
-            break;
+    auto c_client::parse_response(const QByteArray &data) const -> std::expected<QString, s_error>
+    {
+        if (auto text = extract_json_string(data, m_traits->text_path); text && !text->isEmpty())
+        {
+            return *std::move(text);
+        }
+
+        // No answer where it belongs: let the DOM tell what is wrong
+        auto doc = QJsonDocument::fromJson(data);
+        if (doc.isNull() || !doc.isObject())
+        {
+            return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Invalid JSON response") });
         }
+
+        auto obj = doc.object();
+
+        // Check for error response
+        if (obj.contains(QStringLiteral("error")))
+        {
+            auto error_obj = obj[QStringLiteral("error")].toObject();
+            auto error_msg = error_obj[QStringLiteral("message")].toString();
+            return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = error_msg });
         }
 
-        if (content.isEmpty())
+        auto content = find_text(obj, m_traits->text_path, true);
+        if (content.has_value() && content->isEmpty())
         {
             return std::unexpected(s_error{ .code = e_error_code::invalid_response, .message = QStringLiteral("Empty response content") });
         }
@@ -227,23 +887,54 @@ namespace llm
         return content;
     }
 
-    auto c_client::get_endpoint() const -> QString
+    auto c_client::get_endpoint(bool stream) const -> QString
+    {
+        auto endpoint = provider_endpoint(stream);
+        if (m_config.base_url.isEmpty())
+        {
+            return endpoint;
+        }
+
+        // Keep the provider's path and query below the override's own path
+        const QUrl url(endpoint);
+        if (local_socket())
+        {
+            QUrl local(url);
+            local.setScheme(QStringLiteral("http"));
+            local.setHost(QStringLiteral("localhost"));
+            local.setPort(-1);
+            return local.toString();
+        }
+
+        QUrl base(m_config.base_url);
+        auto base_path = base.path();
+        if (base_path.endsWith(QLatin1Char('/')))
+        {
+            base_path.chop(1);
+        }
+        base.setPath(base_path + url.path());
+        base.setQuery(url.query());
+        return base.toString();
+    }
+
+    auto c_client::local_socket() const -> std::optional<QString>
+    {
+        const QUrl base(m_config.base_url);
+        if (base.scheme() != QStringLiteral("unix") || base.path().isEmpty())
+        {
+            return std::nullopt;
+        }
+        return base.path();
+    }
+
+    auto c_client::provider_endpoint(bool stream) const -> QString
     {
-        switch (m_config.provider)
+        const QString endpoint = stream ? m_traits->stream_endpoint : m_traits->endpoint;
+        if (endpoint.contains(QLatin1StringView("%1")))
         {
-        case e_provider::OpenAI:
-            return QStringLiteral("https://api.openai.com/v1/chat/completions");
-        case e_provider::Anthropic:
-            return QStringLiteral("https://api.anthropic.com/v1/messages");
-        case e_provider::OpenRouter:
-            return QStringLiteral("https://openrouter.ai/api/v1/chat/completions");
-        case e_provider::Gemini:
-            return QStringLiteral("https://generativelanguage.googleapis.com/v1beta/models/%1:generateContent")
-                .arg(m_config.model);
-        case e_provider::Groq:
-            return QStringLiteral("https://api.groq.com/openai/v1/chat/completions");
+            return endpoint.arg(m_config.model);
         }
-        return {};
+        return endpoint;
     }
 
 } // namespace llm
@@ -1,39 +1,53 @@
 #ifndef LLMCLIENT_HPP
 #define LLMCLIENT_HPP
 
+#include "llmconnectionpool.hpp"
+#include "llmjson.hpp"
+#include "llmlatency.hpp"
+#include "llmmetrics.hpp"
+#include "llmprovider.hpp"
+#include "llmratelimit.hpp"
+#include "llmsse.hpp"
+
 #include <QEventLoop>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QLoggingCategory>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QPointer>
 #include <QString>
 #include <QTimer>
 
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <expected>
+#include <functional>
 #include <memory>
+#include <optional>
+
+Q_DECLARE_LOGGING_CATEGORY(LLM_CLIENT)
 
 namespace llm
 {
 
-    enum class e_provider : std::uint8_t
-    {
-        OpenAI,
-        Anthropic,
-        OpenRouter,
-        Gemini,
-        Groq
-    };
-
     enum class e_error_code : std::uint8_t
     {
         network_error,
         invalid_api_key,
         invalid_response,
+        // The overall budget ran out
         timeout,
-        rate_limited
+        rate_limited,
+        // No connection to the endpoint within connect_timeout_ms
+        connect_timeout,
+        // The request was sent but no answer started within first_byte_timeout_ms
+        first_byte_timeout,
+        // The answer stopped arriving for idle_timeout_ms
+        idle_timeout
     };
 
     struct s_error
@@ -54,25 +68,199 @@ namespace llm
         QString apiKey;
         QString model;
         int max_tokens{ 150 };
+        // Overall budget of a request, retries included
         int timeout_ms{ 30000 };
+        // Deadlines of the phases of one attempt; 0 disables one. Without streaming the
+        // headers only arrive with the complete answer, so first_byte_timeout_ms only
+        // applies to streams and the overall budget bounds the generation instead.
+        int connect_timeout_ms{ 1500 };
+        int first_byte_timeout_ms{ 15000 };
+        int idle_timeout_ms{ 10000 };
+        // Replaces scheme, host and port of the provider endpoint, e.g. a proxy, a local
+        // server or mock. "unix:///path/to/socket" sends HTTP over a Unix domain socket.
+        QString base_url;
+        // Client-side limits for the account, shared by all clients using it; 0 disables
+        int requests_per_minute{ 0 };
+        int tokens_per_minute{ 0 };
+
+        [[nodiscard]] auto operator==(const s_config &other) const -> bool = default;
     };
 
-    class c_client
+    // Duplicate a slow request to a second provider once the primary has not
+    // sent its first byte within the given percentile of its usual latency.
+    struct s_hedge_config
+    {
+        s_config secondary;
+        double percentile{ 0.95 };
+        // Upper bound on the fraction of requests that may be duplicated
+        double budget{ 0.05 };
+        // Threshold used until enough first-byte samples have been collected
+        std::chrono::milliseconds initial_delay{ 2000 };
+
+        [[nodiscard]] auto operator==(const s_hedge_config &other) const -> bool = default;
+    };
+
+    using t_result = std::expected<QString, s_error>;
+    using t_result_callback = std::function<void(t_result)>;
+    using t_chunk_callback = std::function<void(const QString &chunk)>;
+
+    // Handle to a request started with c_client::send_message_async or send_message_stream.
+    // Copies refer to the same request. Cancelling never invokes the callback.
+    class c_request_handle
     {
     public:
-        explicit c_client(s_config config);
-        ~c_client() = default;
+        c_request_handle() = default;
 
-        [[nodiscard]] auto send_message(const QString &prompt) -> std::expected<QString, s_error>;
+        void cancel();
+        [[nodiscard]] auto is_active() const -> bool;
 
     private:
-        [[nodiscard]] auto build_request() const -> QNetworkRequest;
-        [[nodiscard]] auto build_payload(const QString &prompt) const -> QByteArray;
+        friend class c_client;
+
+        struct s_state
+        {
+            // Aborts every reply and timer; callbacks are no longer invoked afterwards
+            void stop();
+
+            // Earlier turns sent ahead of the prompt; the hedge sends them too
+            QList<s_message> history;
+            t_chunk_callback on_chunk;
+            t_result_callback on_finished;
+            // The primary reply and, when hedged, its duplicate
+            QList<QPointer<QNetworkReply>> replies;
+            // The reply that streamed first; the others are losers
+            QPointer<QNetworkReply> winner;
+            QPointer<QTimer> deadline;
+            QPointer<QTimer> hedge_timer;
+            std::chrono::steady_clock::time_point deadline_at;
+            std::optional<s_error> error;
+            // Lanes (primary, hedge) that have not failed yet, including those waiting to retry
+            int pending{ 0 };
+            bool first_byte{ false };
+            bool finished{ false };
+            bool timed_out{ false };
+        };
+
+        std::shared_ptr<s_state> m_state;
+    };
+
+    class c_client
+    {
+    public:
+        // Clients borrow the connections of `pool`; without one they create a private pool
+        explicit c_client(s_config config, std::shared_ptr<c_connection_pool> pool = nullptr);
+        ~c_client();
+
+        c_client(const c_client &) = delete;
+        auto operator=(const c_client &) -> c_client & = delete;
+
+        // Blocks in a local event loop until the reply lands; prefer send_message_async
+        [[nodiscard]] auto send_message(const QString &prompt) -> t_result;
+
+        // Returns immediately; `on_finished` runs on this thread's event loop.
+        // Destroying the client cancels its outstanding requests.
+        auto send_message_async(const QString &prompt, t_result_callback on_finished) -> c_request_handle;
+        // Asks `prompt` as a follow-up to the alternating user/assistant turns of `history`
+        auto send_message_async(const QList<s_message> &history, const QString &prompt, t_result_callback on_finished) -> c_request_handle;
+
+        // Requests a server-sent-events stream; `on_chunk` receives each text delta
+        // as it arrives and `on_finished` the complete answer once the stream ends.
+        auto send_message_stream(const QString &prompt, t_chunk_callback on_chunk, t_result_callback on_finished) -> c_request_handle;
+        auto send_message_stream(const QList<s_message> &history, const QString &prompt, t_chunk_callback on_chunk, t_result_callback on_finished) -> c_request_handle;
+
+        // Extracts the text delta from one streamed event; empty for bookkeeping events
+        [[nodiscard]] auto parse_stream_event(const s_sse_event &event) const -> t_result;
+
+        [[nodiscard]] auto get_endpoint(bool stream = false) const -> QString;
+        // Path of the Unix domain socket requests go to, if base_url names one
+        [[nodiscard]] auto local_socket() const -> std::optional<QString>;
+
+        // The pieces of a request, public so they can be benchmarked in isolation
+        [[nodiscard]] auto build_request(bool stream = false) const -> QNetworkRequest;
+        [[nodiscard]] auto build_payload(const QString &prompt, bool stream = false) const -> QByteArray;
+        [[nodiscard]] auto build_payload(const QList<s_message> &history, const QString &prompt, bool stream = false) const -> QByteArray;
         [[nodiscard]] auto parse_response(const QByteArray &data) const -> std::expected<QString, s_error>;
-        [[nodiscard]] auto get_endpoint() const -> QString;
+
+        // Enables hedging of slow requests to `hedge.secondary`; nullopt disables it
+        void set_hedging(std::optional<s_hedge_config> hedge);
+        // Applies token, timeout and rate limits in place. Returns false without changing
+        // anything when the provider, key, model or server differ and a new client is needed.
+        [[nodiscard]] auto reconfigure(const s_config &config) -> bool;
+
+        // Phase latencies of this provider/model, shared with every client using it
+        [[nodiscard]] auto metrics() const -> c_phase_metrics &;
+
+    private:
+        struct s_stream_state
+        {
+            c_sse_parser parser;
+            QString text;
+            std::optional<s_error> error;
+        };
+
+        // A serialized payload with a gap where the escaped prompt goes
+        struct s_payload_skeleton
+        {
+            QByteArray prefix;
+            QByteArray suffix;
+        };
+
+        // Aborts a reply that stays in one phase for longer than its deadline
+        struct s_watchdog
+        {
+            QPointer<QTimer> timer;
+            // What running out of time in the current phase is reported as
+            e_error_code phase{ e_error_code::connect_timeout };
+            bool expired{ false };
+        };
+
+        // When one reply reached each network milestone
+        struct s_timeline
+        {
+            std::chrono::steady_clock::time_point posted;
+            std::optional<std::chrono::steady_clock::time_point> connecting;
+            std::optional<std::chrono::steady_clock::time_point> sent;
+            std::optional<std::chrono::steady_clock::time_point> first_byte;
+        };
+
+        using t_state = std::shared_ptr<c_request_handle::s_state>;
+
+        auto start_request(const QList<s_message> &history, const QString &prompt, t_chunk_callback on_chunk, t_result_callback on_finished) -> c_request_handle;
+        void launch(const t_state &state, const QString &prompt, int attempt = 0);
+        void post(const t_state &state, const QString &prompt, int attempt);
+        [[nodiscard]] auto retry_delay(QNetworkReply &reply, const t_state &state, int attempt) const -> std::optional<std::chrono::milliseconds>;
+        static void fail_lane(const t_state &state, s_error error);
+        void arm_watchdog(QNetworkReply &reply, const std::shared_ptr<s_watchdog> &watchdog, bool stream) const;
+        void record_timeline(const s_timeline &timeline, std::chrono::steady_clock::time_point finished) const;
+        void arm_hedge(const t_state &state, const QString &prompt);
+        [[nodiscard]] auto hedge_delay() const -> std::chrono::milliseconds;
+        void consume_stream(QNetworkReply &reply, s_stream_state &stream, const t_state &state) const;
+        [[nodiscard]] auto finish_stream(QNetworkReply &reply, s_stream_state &stream, const t_state &state, std::optional<e_error_code> expired) const -> t_result;
+        static void complete(const t_state &state, t_result result);
+        [[nodiscard]] auto provider_endpoint(bool stream) const -> QString;
+        [[nodiscard]] auto make_request(bool stream) const -> QNetworkRequest;
+        // The request body for a question and the turns before it
+        [[nodiscard]] auto make_payload(const QList<s_message> &messages, bool stream) const -> QJsonObject;
+        [[nodiscard]] auto make_payload_skeleton(bool stream) const -> s_payload_skeleton;
+        // `expired` is the deadline that aborted the reply, if any
+        [[nodiscard]] auto read_reply(QNetworkReply &reply, std::optional<e_error_code> expired) const -> t_result;
+        [[nodiscard]] auto reply_error(QNetworkReply &reply, std::optional<e_error_code> expired) const -> std::optional<s_error>;
 
         s_config m_config;
-        std::unique_ptr<QNetworkAccessManager> m_networkManager;
+        std::shared_ptr<c_connection_pool> m_pool;
+        const s_provider_traits *m_traits;
+        // Indexed by the stream flag
+        std::array<QNetworkRequest, 2> m_request_skeletons;
+        std::array<s_payload_skeleton, 2> m_payload_skeletons;
+        std::shared_ptr<c_rate_limiter> m_rate_limiter;
+        // Parent of all outstanding replies and context of their callbacks
+        std::unique_ptr<QObject> m_reply_context;
+        c_latency_window m_first_byte_latency;
+        c_phase_metrics *m_metrics{ nullptr };
+        std::optional<s_hedge_config> m_hedge;
+        std::unique_ptr<c_client> m_hedge_client;
+        qint64 m_requests{ 0 };
+        qint64 m_hedges{ 0 };
     };
 
 } // namespace llm
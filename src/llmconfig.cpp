@@ -3,6 +3,7 @@
 #include <KConfigGroup>
 #include <KPluginFactory>
 #include <KSharedConfig>
+#include <QCheckBox>
 #include <QComboBox>
 
 K_PLUGIN_CLASS_WITH_JSON(c_llm_config, "kcm_krunner_llm.json")
@@ -18,6 +19,7 @@ c_llm_config::c_llm_config(QObject *parent, const KPluginMetaData &metaData)
     m_ui->providerCombo->addItem(QStringLiteral("OpenRouter"), QStringLiteral("OpenRouter"));
     m_ui->providerCombo->addItem(QStringLiteral("Google Gemini"), QStringLiteral("Gemini"));
     m_ui->providerCombo->addItem(QStringLiteral("Groq"), QStringLiteral("Groq"));
+    m_ui->providerCombo->addItem(QStringLiteral("Local / OpenAI-compatible"), QStringLiteral("Local"));
 
     connect(m_ui->providerCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &::c_llm_config::on_provider_changed);
@@ -25,14 +27,34 @@ c_llm_config::c_llm_config(QObject *parent, const KPluginMetaData &metaData)
             this, &::c_llm_config::on_settings_changed);
     connect(m_ui->modelEdit, &QLineEdit::textChanged,
             this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->baseUrlEdit, &QLineEdit::textChanged,
+            this, &::c_llm_config::on_settings_changed);
     connect(m_ui->triggerWordEdit, &QLineEdit::textChanged,
             this, &::c_llm_config::on_settings_changed);
     connect(m_ui->maxTokensSpin, QOverload<int>::of(&QSpinBox::valueChanged),
             this, &::c_llm_config::on_settings_changed);
     connect(m_ui->timeoutSpin, QOverload<int>::of(&QSpinBox::valueChanged),
             this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->connectTimeoutSpin, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+            this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->firstByteTimeoutSpin, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->idleTimeoutSpin, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &::c_llm_config::on_settings_changed);
     connect(m_ui->debounceDelaySpin, QOverload<int>::of(&QSpinBox::valueChanged),
             this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->adaptiveDebounceCheck, &QCheckBox::toggled,
+            this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->adaptiveDebounceCheck, &QCheckBox::toggled,
+            m_ui->debounceMinSpin, &QWidget::setEnabled);
+    connect(m_ui->adaptiveDebounceCheck, &QCheckBox::toggled,
+            m_ui->debounceMaxSpin, &QWidget::setEnabled);
+    connect(m_ui->debounceMinSpin, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->debounceMaxSpin, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &::c_llm_config::on_settings_changed);
+    connect(m_ui->streamingCheck, &QCheckBox::toggled,
+            this, &::c_llm_config::on_settings_changed);
 
     load();
 }
@@ -63,15 +85,41 @@ void c_llm_config::load()
     auto model = group.readEntry(QStringLiteral("Model"), QStringLiteral("gpt-4"));
     m_ui->modelEdit->setText(model);
 
+    auto baseUrl = group.readEntry(QStringLiteral("BaseUrl"), QString());
+    m_ui->baseUrlEdit->setText(baseUrl);
+
     auto maxTokens = group.readEntry(QStringLiteral("MaxTokens"), 150);
     m_ui->maxTokensSpin->setValue(maxTokens);
 
     auto timeout = group.readEntry(QStringLiteral("Timeout"), 30000);
     m_ui->timeoutSpin->setValue(timeout / 1000); // Convert to seconds
 
+    auto connectTimeout = group.readEntry(QStringLiteral("ConnectTimeout"), 1500);
+    m_ui->connectTimeoutSpin->setValue(connectTimeout / 1000.0); // Convert to seconds
+
+    auto firstByteTimeout = group.readEntry(QStringLiteral("FirstByteTimeout"), 15000);
+    m_ui->firstByteTimeoutSpin->setValue(firstByteTimeout / 1000);
+
+    auto idleTimeout = group.readEntry(QStringLiteral("IdleTimeout"), 10000);
+    m_ui->idleTimeoutSpin->setValue(idleTimeout / 1000);
+
     auto debounceDelay = group.readEntry(QStringLiteral("DebounceDelay"), 800);
     m_ui->debounceDelaySpin->setValue(debounceDelay);
 
+    auto adaptiveDebounce = group.readEntry(QStringLiteral("AdaptiveDebounce"), true);
+    m_ui->adaptiveDebounceCheck->setChecked(adaptiveDebounce);
+    m_ui->debounceMinSpin->setEnabled(adaptiveDebounce);
+    m_ui->debounceMaxSpin->setEnabled(adaptiveDebounce);
+
+    auto debounceMin = group.readEntry(QStringLiteral("DebounceMin"), 250);
+    m_ui->debounceMinSpin->setValue(debounceMin);
+
+    auto debounceMax = group.readEntry(QStringLiteral("DebounceMax"), 1500);
+    m_ui->debounceMaxSpin->setValue(debounceMax);
+
+    auto streaming = group.readEntry(QStringLiteral("Streaming"), true);
+    m_ui->streamingCheck->setChecked(streaming);
+
     setNeedsSave(false);
 }
 
@@ -80,13 +128,22 @@ void c_llm_config::save()
     auto config = KSharedConfig::openConfig(QStringLiteral("krunnerllmrc"));
     auto group = config->group(QStringLiteral("General"));
 
-    group.writeEntry(QStringLiteral("TriggerWord"), m_ui->triggerWordEdit->text());
-    group.writeEntry(QStringLiteral("ApiKey"), m_ui->apiKeyEdit->text());
-    group.writeEntry(QStringLiteral("Provider"), m_ui->providerCombo->currentData().toString());
-    group.writeEntry(QStringLiteral("Model"), m_ui->modelEdit->text());
-    group.writeEntry(QStringLiteral("MaxTokens"), m_ui->maxTokensSpin->value());
-    group.writeEntry(QStringLiteral("Timeout"), m_ui->timeoutSpin->value() * 1000); // Convert to ms
-    group.writeEntry(QStringLiteral("DebounceDelay"), m_ui->debounceDelaySpin->value());
+    // Notify lets a running KRunner pick the changes up without a restart
+    group.writeEntry(QStringLiteral("TriggerWord"), m_ui->triggerWordEdit->text(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("ApiKey"), m_ui->apiKeyEdit->text(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("Provider"), m_ui->providerCombo->currentData().toString(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("Model"), m_ui->modelEdit->text(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("BaseUrl"), m_ui->baseUrlEdit->text().trimmed(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("MaxTokens"), m_ui->maxTokensSpin->value(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("Timeout"), m_ui->timeoutSpin->value() * 1000, KConfig::Notify); // Convert to ms
+    group.writeEntry(QStringLiteral("ConnectTimeout"), qRound(m_ui->connectTimeoutSpin->value() * 1000), KConfig::Notify);
+    group.writeEntry(QStringLiteral("FirstByteTimeout"), m_ui->firstByteTimeoutSpin->value() * 1000, KConfig::Notify);
+    group.writeEntry(QStringLiteral("IdleTimeout"), m_ui->idleTimeoutSpin->value() * 1000, KConfig::Notify);
+    group.writeEntry(QStringLiteral("DebounceDelay"), m_ui->debounceDelaySpin->value(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("AdaptiveDebounce"), m_ui->adaptiveDebounceCheck->isChecked(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("DebounceMin"), m_ui->debounceMinSpin->value(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("DebounceMax"), m_ui->debounceMaxSpin->value(), KConfig::Notify);
+    group.writeEntry(QStringLiteral("Streaming"), m_ui->streamingCheck->isChecked(), KConfig::Notify);
 
     config->sync();
     setNeedsSave(false);
@@ -98,9 +155,17 @@ void c_llm_config::defaults()
     m_ui->apiKeyEdit->clear();
     m_ui->providerCombo->setCurrentIndex(0); // OpenAI
     m_ui->modelEdit->setText(QStringLiteral("gpt-4"));
+    m_ui->baseUrlEdit->clear();
     m_ui->maxTokensSpin->setValue(150);
     m_ui->timeoutSpin->setValue(30);
+    m_ui->connectTimeoutSpin->setValue(1.5);
+    m_ui->firstByteTimeoutSpin->setValue(15);
+    m_ui->idleTimeoutSpin->setValue(10);
     m_ui->debounceDelaySpin->setValue(800);
+    m_ui->adaptiveDebounceCheck->setChecked(true);
+    m_ui->debounceMinSpin->setValue(250);
+    m_ui->debounceMaxSpin->setValue(1500);
+    m_ui->streamingCheck->setChecked(true);
 
     setNeedsSave(true);
 }
@@ -136,6 +201,16 @@ void c_llm_config::on_provider_changed(int index)
         m_ui->modelEdit->setText(QStringLiteral("llama-3.3-70b-versatile"));
         m_ui->modelEdit->setPlaceholderText(QStringLiteral("e.g., llama-3.3-70b-versatile, mixtral-8x7b-32768"));
     }
+    else if (provider == QStringLiteral("Local"))
+    {
+        m_ui->modelEdit->setText(QStringLiteral("llama3.2"));
+        m_ui->modelEdit->setPlaceholderText(QStringLiteral("e.g., llama3.2, qwen2.5 (ignored by llama.cpp)"));
+    }
+
+    // Without a base URL a local provider is looked for on llama.cpp's default port
+    const auto local = provider == QStringLiteral("Local");
+    m_ui->baseUrlEdit->setPlaceholderText(local ? QStringLiteral("http://localhost:8080") : QString());
+    m_ui->apiKeyEdit->setPlaceholderText(local ? QStringLiteral("Optional") : QString());
 
     on_settings_changed();
 }
@@ -0,0 +1,103 @@
+#include "llmconnectionpool.hpp"
+
+namespace llm
+{
+
+    c_connection_pool::c_connection_pool()
+        : m_manager(std::make_unique<QNetworkAccessManager>()),
+          m_ssl_config(QSslConfiguration::defaultConfiguration()),
+          m_idle_timer(std::make_unique<QTimer>())
+    {
+        // Session persistence is off by default in Qt; enabling it lets new
+        // connections resume the TLS session instead of a full handshake.
+        m_ssl_config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        m_ssl_config.setSslOption(QSsl::SslOptionDisableSessionSharing, false);
+        m_ssl_config.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+
+        // connectToHostEncrypted() only negotiates HTTP/2 when it is offered via ALPN;
+        // without it a prewarmed socket would not match the later HTTP/2 requests.
+        m_ssl_config.setAllowedNextProtocols({ QSslConfiguration::ALPNProtocolHTTP2, QSslConfiguration::NextProtocolHttp1_1 });
+
+        m_idle_timer->setSingleShot(true);
+        QObject::connect(m_idle_timer.get(), &QTimer::timeout, m_manager.get(), [this]()
+                         {
+                         // Never tear down sockets underneath running replies
+                         if (m_active_replies > 0)
+                         {
+                             touch();
+                             return;
+                         }
+                         m_manager->clearConnectionCache(); });
+    }
+
+    auto c_connection_pool::manager() const -> QNetworkAccessManager *
+    {
+        return m_manager.get();
+    }
+
+    void c_connection_pool::prepare(QNetworkRequest &request)
+    {
+        request.setSslConfiguration(m_ssl_config);
+        request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+        request.setAttribute(QNetworkRequest::ConnectionCacheExpiryTimeoutSecondsAttribute, static_cast<int>(m_keep_alive.count()));
+        touch();
+    }
+
+    auto c_connection_pool::post(QNetworkRequest request, const QByteArray &payload) -> QNetworkReply *
+    {
+        prepare(request);
+        auto *reply = m_manager->post(request, payload);
+
+        ++m_active_replies;
+        QObject::connect(reply, &QObject::destroyed, m_manager.get(), [this]()
+                         {
+                         --m_active_replies;
+                         touch(); });
+        return reply;
+    }
+
+    void c_connection_pool::prewarm(const QUrl &endpoint)
+    {
+        if (!endpoint.isValid() || endpoint.host().isEmpty())
+        {
+            return;
+        }
+
+        const bool encrypted = endpoint.scheme() == QStringLiteral("https");
+        const auto port = static_cast<quint16>(endpoint.port(encrypted ? 443 : 80));
+        const auto host_key = QStringLiteral("%1:%2").arg(endpoint.host()).arg(port);
+
+        const auto now = std::chrono::steady_clock::now();
+        if (auto it = m_last_prewarm.constFind(host_key); it != m_last_prewarm.cend() && now - it.value() < m_prewarm_interval)
+        {
+            return;
+        }
+        m_last_prewarm.insert(host_key, now);
+
+        if (encrypted)
+        {
+            m_manager->connectToHostEncrypted(endpoint.host(), port, m_ssl_config);
+        }
+        else
+        {
+            m_manager->connectToHost(endpoint.host(), port);
+        }
+        touch();
+    }
+
+    void c_connection_pool::set_keep_alive(std::chrono::seconds keep_alive)
+    {
+        m_keep_alive = keep_alive;
+    }
+
+    void c_connection_pool::set_prewarm_interval(std::chrono::seconds interval)
+    {
+        m_prewarm_interval = interval;
+    }
+
+    void c_connection_pool::touch()
+    {
+        m_idle_timer->start(std::chrono::duration_cast<std::chrono::milliseconds>(m_keep_alive));
+    }
+
+} // namespace llm
@@ -0,0 +1,62 @@
+#ifndef LLMCONNECTIONPOOL_HPP
+#define LLMCONNECTIONPOOL_HPP
+
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QSslConfiguration>
+#include <QTimer>
+#include <QUrl>
+
+#include <chrono>
+#include <memory>
+
+namespace llm
+{
+
+    // Long-lived network layer shared by every c_client of a runner.
+    // Keeping a single QNetworkAccessManager alive lets Qt reuse keep-alive
+    // sockets, multiplex requests over HTTP/2 and resume TLS sessions, so only
+    // the first query to a host pays for DNS, TCP and the TLS handshake.
+    // Like any QObject it must be used from the thread that created it.
+    class c_connection_pool
+    {
+    public:
+        c_connection_pool();
+        ~c_connection_pool() = default;
+
+        c_connection_pool(const c_connection_pool &) = delete;
+        auto operator=(const c_connection_pool &) -> c_connection_pool & = delete;
+
+        [[nodiscard]] auto manager() const -> QNetworkAccessManager *;
+
+        // Applies the connection reuse settings to a request built by a client
+        void prepare(QNetworkRequest &request);
+
+        // Prepares and posts a request; the pool keeps idle sockets open while it runs
+        [[nodiscard]] auto post(QNetworkRequest request, const QByteArray &payload) -> QNetworkReply *;
+
+        // Opens (and for https, handshakes) a connection to the endpoint's host
+        // ahead of the first request. Repeated calls for the same host within
+        // the prewarm interval are ignored.
+        void prewarm(const QUrl &endpoint);
+
+        // Idle sockets are closed after `keep_alive` without any traffic
+        void set_keep_alive(std::chrono::seconds keep_alive);
+        void set_prewarm_interval(std::chrono::seconds interval);
+
+    private:
+        void touch();
+
+        std::unique_ptr<QNetworkAccessManager> m_manager;
+        QSslConfiguration m_ssl_config;
+        std::unique_ptr<QTimer> m_idle_timer;
+        std::chrono::seconds m_keep_alive{ 120 };
+        std::chrono::seconds m_prewarm_interval{ 30 };
+        QHash<QString, std::chrono::steady_clock::time_point> m_last_prewarm;
+        int m_active_replies{ 0 };
+    };
+
+} // namespace llm
+
+#endif // LLMCONNECTIONPOOL_HPP
@@ -0,0 +1,332 @@
+#include "llmdaemon.hpp"
+#include <KLocalizedString>
+#include <KSharedConfig>
+#include <KSystemClipboard>
+#include <QDBusConnection>
+#include <QMimeData>
+
+#include <utility>
+
+namespace
+{
+    // KRunner::QueryMatch::CategoryRelevance values
+    constexpr int relevance_moderate = 50;
+    constexpr int relevance_high = 70;
+    constexpr int relevance_highest = 100;
+
+    // Answers Run() can still find; older ids are forgotten
+    constexpr qsizetype max_answers = 32;
+
+    // Held Match calls are answered before KRunner's 25 s D-Bus timeout gives up on them
+    constexpr auto max_reply_wait = std::chrono::seconds(20);
+
+    const auto copy_action = QStringLiteral("copy");
+} // namespace
+
+c_llm_daemon::c_llm_daemon(QObject *parent)
+    : QObject(parent)
+    , m_reply_wait(max_reply_wait)
+{
+    load_config();
+
+    // The KCM saves with KConfig::Notify; caches and untouched clients survive a reload
+    m_config_watcher = KConfigWatcher::create(KSharedConfig::openConfig(QStringLiteral("krunnerllmrc")));
+    connect(m_config_watcher.data(), &KConfigWatcher::configChanged, this, [this]()
+            { load_config(); });
+}
+
+void c_llm_daemon::set_reply_wait(std::chrono::milliseconds wait)
+{
+    m_reply_wait = wait;
+}
+
+void c_llm_daemon::load_config()
+{
+    const auto settings = llm::read_settings(KSharedConfig::openConfig(QStringLiteral("krunnerllmrc")));
+    m_trigger_word = settings.trigger_word;
+    m_engine.apply(settings);
+}
+
+llm::t_remote_actions c_llm_daemon::Actions()
+{
+    return { llm::s_remote_action{ .id = copy_action, .text = i18n("Copy to Clipboard"), .icon_name = QStringLiteral("edit-copy") } };
+}
+
+QVariantMap c_llm_daemon::Config()
+{
+    // KRunner skips the D-Bus round trip for queries without the trigger word
+    return {
+        { QStringLiteral("TriggerWords"), QStringList{ m_trigger_word } },
+        { QStringLiteral("MinLetterCount"), static_cast<int>(m_trigger_word.length() + 2) },
+    };
+}
+
+llm::t_remote_matches c_llm_daemon::Match(const QString &query)
+{
+    const auto sender = message().service();
+    const QString trigger_with_space = m_trigger_word + QLatin1Char(' ');
+    const bool triggered = query.startsWith(trigger_with_space, Qt::CaseInsensitive);
+    const auto prompt = triggered ? query.mid(trigger_with_space.length()).trimmed() : QString();
+
+    // KRunner asking the same question again keeps its place instead of starting over
+    if (m_engine.configured() && !prompt.isEmpty() && reattach(sender, prompt))
+    {
+        setDelayedReply(true);
+        return {};
+    }
+    release(sender);
+
+    if (!triggered)
+    {
+        return {};
+    }
+
+    if (!m_engine.configured())
+    {
+        return { status_match(i18n("LLM Runner Not Configured"), i18n("Please configure your API key in KRunner settings"), QStringLiteral("configure")) };
+    }
+
+    if (prompt.isEmpty())
+    {
+        // A question is about to be typed: get DNS, TCP and TLS out of the way now
+        m_engine.prewarm();
+        return {};
+    }
+    m_engine.record_keystroke(prompt);
+
+    if (auto cached = m_engine.cached_response(m_engine.cache_key(prompt)))
+    {
+        return { answer_match(prompt, *cached) };
+    }
+
+    // Nothing could reach a provider: say so now rather than after DNS, TCP or a timeout
+    if (m_engine.unreachable())
+    {
+        m_engine.queue_offline(prompt);
+        return { offline_match() };
+    }
+
+    // A finished-looking question skips the debounce; the client's next Match releases it
+    const bool speculate = m_engine.speculate(prompt);
+
+    // Hold the call until the debounce runs out and the answer arrives
+    setDelayedReply(true);
+    auto &pending = m_pending[sender];
+    pending.prompt = prompt;
+    hold(pending, sender);
+    if (!pending.timer)
+    {
+        pending.timer = new QTimer(this);
+        pending.timer->setSingleShot(true);
+        connect(pending.timer, &QTimer::timeout, this, [this, sender]()
+                { perform_query(sender); });
+    }
+    pending.timer->start(speculate ? std::chrono::milliseconds(0) : m_engine.debounce_delay());
+    return {};
+}
+
+void c_llm_daemon::Run(const QString &match_id, const QString &action_id)
+{
+    Q_UNUSED(action_id);
+
+    // Activating the answer and its copy action both copy it
+    const auto it = m_answers.constFind(match_id);
+    if (it == m_answers.cend())
+    {
+        return;
+    }
+
+    auto *mime = new QMimeData;
+    mime->setText(it->response);
+    KSystemClipboard::instance()->setMimeData(mime, QClipboard::Clipboard);
+
+    // An answer the user took is context for the follow-up questions
+    m_engine.take_answer(it->prompt, it->response);
+}
+
+void c_llm_daemon::Teardown()
+{
+    const auto sender = message().service();
+    release(sender);
+    auto pending = m_pending.take(sender);
+    for (const auto &timer : { pending.timer, pending.deadline })
+    {
+        if (timer)
+        {
+            timer->deleteLater();
+        }
+    }
+}
+
+void c_llm_daemon::release(const QString &sender)
+{
+    auto pending = m_pending.find(sender);
+    if (pending == m_pending.end() || pending->message.type() == QDBusMessage::InvalidMessage)
+    {
+        return;
+    }
+
+    reply(std::exchange(pending->message, QDBusMessage()), {});
+
+    // Still debouncing: the question never left the daemon
+    if (pending->timer && pending->timer->isActive())
+    {
+        pending->timer->stop();
+        return;
+    }
+
+    // On the wire: stop waiting for it, and stop it when nobody else does
+    m_engine.detach(sender);
+}
+
+auto c_llm_daemon::reattach(const QString &sender, const QString &prompt) -> bool
+{
+    auto pending = m_pending.find(sender);
+    if (pending == m_pending.end() || pending->message.type() == QDBusMessage::InvalidMessage || pending->prompt != prompt)
+    {
+        return false;
+    }
+
+    // Still debouncing, or on the wire: either carries on and answers the new call
+    if ((pending->timer && pending->timer->isActive()) || m_engine.waiting(prompt, sender))
+    {
+        reply(pending->message, {});
+        hold(*pending, sender);
+        return true;
+    }
+    return false;
+}
+
+void c_llm_daemon::hold(s_pending &pending, const QString &sender)
+{
+    pending.message = message();
+    if (!pending.deadline)
+    {
+        pending.deadline = new QTimer(this);
+        pending.deadline->setSingleShot(true);
+        connect(pending.deadline, &QTimer::timeout, this, [this, sender]()
+                { expire(sender); });
+    }
+    pending.deadline->start(m_reply_wait);
+}
+
+void c_llm_daemon::expire(const QString &sender)
+{
+    auto pending = m_pending.find(sender);
+    if (pending == m_pending.end() || pending->message.type() == QDBusMessage::InvalidMessage)
+    {
+        return;
+    }
+
+    const auto held = std::exchange(pending->message, QDBusMessage());
+    if (pending->timer)
+    {
+        pending->timer->stop();
+    }
+
+    // The request is left running so its answer lands in the cache for the next Match
+    m_engine.detach(sender, true);
+    reply(held, { status_match(i18n("Still Thinking"), i18n("The answer is taking a while; ask again to pick it up"), QStringLiteral("view-refresh")) });
+}
+
+void c_llm_daemon::perform_query(const QString &sender)
+{
+    auto pending = m_pending.find(sender);
+    if (pending == m_pending.end() || pending->message.type() == QDBusMessage::InvalidMessage)
+    {
+        return;
+    }
+
+    // The network may have gone while the debounce ran
+    if (m_engine.unreachable())
+    {
+        m_engine.queue_offline(pending->prompt);
+        reply_to(sender, { offline_match() });
+        return;
+    }
+
+    // Single-flight: every client asking the same question shares one reply
+    const auto prompt = pending->prompt;
+    m_engine.ask(prompt, {
+                             .owner = sender,
+                             .answer = [this, sender, prompt](const QString &answer, llm::c_query_engine::e_answer kind)
+                             {
+                                 // A D-Bus reply carries the whole answer; drafts and partial answers wait for it
+                                 return kind != llm::c_query_engine::e_answer::complete || reply_to(sender, { answer_match(prompt, answer) });
+                             },
+                             .fail = [this, sender](const llm::s_error &error)
+                             { return reply_to(sender, { error_match(error) }); },
+                         });
+}
+
+auto c_llm_daemon::reply_to(const QString &sender, const llm::t_remote_matches &matches) -> bool
+{
+    // The client's latest question has been answered
+    auto pending = m_pending.find(sender);
+    if (pending == m_pending.end() || pending->message.type() == QDBusMessage::InvalidMessage)
+    {
+        return false;
+    }
+    reply(std::exchange(pending->message, QDBusMessage()), matches);
+    if (pending->deadline)
+    {
+        pending->deadline->stop();
+    }
+    return true;
+}
+
+void c_llm_daemon::reply(const QDBusMessage &message, const llm::t_remote_matches &matches) const
+{
+    QDBusConnection::sessionBus().send(message.createReply(QVariant::fromValue(matches)));
+}
+
+auto c_llm_daemon::answer_match(const QString &prompt, const QString &response) -> llm::s_remote_match
+{
+    const auto id = QStringLiteral("answer-%1").arg(++m_next_answer);
+    m_answers.insert(id, s_answer{ .prompt = prompt, .response = response });
+    m_answer_order.append(id);
+    while (m_answer_order.size() > max_answers)
+    {
+        m_answers.remove(m_answer_order.takeFirst());
+    }
+
+    return llm::s_remote_match{
+        .id = id,
+        .text = response,
+        .icon_name = QStringLiteral("dialog-information"),
+        .category_relevance = relevance_highest,
+        .relevance = 1.0,
+        .properties = {
+            { QStringLiteral("subtext"), i18n("Click to copy response") },
+            { QStringLiteral("actions"), QStringList{ copy_action } },
+            { QStringLiteral("multiline"), true },
+        },
+    };
+}
+
+auto c_llm_daemon::status_match(const QString &text, const QString &subtext, const QString &icon_name) const -> llm::s_remote_match
+{
+    return llm::s_remote_match{
+        .id = QStringLiteral("status"),
+        .text = text,
+        .icon_name = icon_name,
+        .category_relevance = relevance_moderate,
+        .relevance = 1.0,
+        .properties = { { QStringLiteral("subtext"), subtext }, { QStringLiteral("actions"), QStringList() } },
+    };
+}
+
+auto c_llm_daemon::error_match(const llm::s_error &error) const -> llm::s_remote_match
+{
+    const auto description = llm::describe(error);
+    auto match = status_match(description.text, description.subtext, QStringLiteral("dialog-error"));
+    match.category_relevance = relevance_high;
+    match.relevance = 0.8;
+    return match;
+}
+
+auto c_llm_daemon::offline_match() const -> llm::s_remote_match
+{
+    const auto subtext = m_engine.replays_offline() ? i18n("The question will be asked once the network is back") : i18n("Connect to a network to ask the LLM");
+    return status_match(i18n("You are offline"), subtext, QStringLiteral("network-offline"));
+}
@@ -0,0 +1,88 @@
+#ifndef LLMDAEMON_HPP
+#define LLMDAEMON_HPP
+
+#include "llmdbus.hpp"
+#include "llmengine.hpp"
+#include "llmsettings.hpp"
+#include <KConfigWatcher>
+#include <QDBusContext>
+#include <QDBusMessage>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <chrono>
+
+// Out-of-process runner serving org.kde.krunner1 on /runner. It keeps the
+// connection pool, the caches and the sessions alive between KRunner
+// invocations and answers each D-Bus client (KRunner, Milou, ...) on its own:
+// a Match call is held as a delayed reply until the answer arrives, and a newer
+// Match from the same client releases the older one with no matches.
+class c_llm_daemon : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.krunner1")
+
+    // The latest question of one D-Bus client, until its debounce runs out
+    struct s_pending
+    {
+        QString prompt;
+        QDBusMessage message;
+        QPointer<QTimer> timer;
+        // Answers the held call before the client's own D-Bus timeout does
+        QPointer<QTimer> deadline;
+    };
+
+    // What Run() needs to copy an answer and continue the session with it
+    struct s_answer
+    {
+        QString prompt;
+        QString response;
+    };
+
+public:
+    explicit c_llm_daemon(QObject *parent = nullptr);
+
+    // How long a Match call is held at most; tests shorten it
+    void set_reply_wait(std::chrono::milliseconds wait);
+
+    // The org.kde.krunner1 methods; moc needs the leading return types
+public Q_SLOTS:
+    llm::t_remote_actions Actions();
+    llm::t_remote_matches Match(const QString &query);
+    void Run(const QString &match_id, const QString &action_id);
+    QVariantMap Config();
+    void Teardown();
+
+private:
+    void load_config();
+    // Answers the client's previous Match with nothing and forgets it
+    void release(const QString &sender);
+    // Moves the client's held question over to the current call when it asks the same again
+    [[nodiscard]] auto reattach(const QString &sender, const QString &prompt) -> bool;
+    // Holds the current call for the client, to be answered by the deadline at the latest
+    void hold(s_pending &pending, const QString &sender);
+    void expire(const QString &sender);
+    void perform_query(const QString &sender);
+    // Answers the client's held call; false when it holds none
+    auto reply_to(const QString &sender, const llm::t_remote_matches &matches) -> bool;
+    void reply(const QDBusMessage &message, const llm::t_remote_matches &matches) const;
+    [[nodiscard]] auto answer_match(const QString &prompt, const QString &response) -> llm::s_remote_match;
+    [[nodiscard]] auto status_match(const QString &text, const QString &subtext, const QString &icon_name) const -> llm::s_remote_match;
+    [[nodiscard]] auto error_match(const llm::s_error &error) const -> llm::s_remote_match;
+    [[nodiscard]] auto offline_match() const -> llm::s_remote_match;
+
+    QString m_trigger_word;
+    std::chrono::milliseconds m_reply_wait;
+    llm::c_query_engine m_engine{ this, QStringLiteral("daemon"), false };
+    // Keyed by D-Bus sender
+    QHash<QString, s_pending> m_pending;
+    // Keyed by match id; only the most recent answers can be run
+    QHash<QString, s_answer> m_answers;
+    QList<QString> m_answer_order;
+    quint64 m_next_answer{ 0 };
+    KConfigWatcher::Ptr m_config_watcher;
+};
+
+#endif // LLMDAEMON_HPP
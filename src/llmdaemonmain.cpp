@@ -0,0 +1,29 @@
+#include "llmdaemon.hpp"
+#include <KLocalizedString>
+#include <QDBusConnection>
+#include <QGuiApplication>
+
+int main(int argc, char *argv[])
+{
+    // A GUI application only for the clipboard; the daemon shows no windows
+    QGuiApplication app(argc, argv);
+    app.setQuitOnLastWindowClosed(false);
+    KLocalizedString::setApplicationDomain("krunner_llm");
+
+    llm::register_dbus_types();
+    c_llm_daemon daemon;
+
+    auto bus = QDBusConnection::sessionBus();
+    if (!bus.registerObject(QStringLiteral("/runner"), &daemon, QDBusConnection::ExportAllSlots))
+    {
+        qCritical("Cannot export the runner on the session bus");
+        return 1;
+    }
+    if (!bus.registerService(QStringLiteral("org.kde.krunner_llm")))
+    {
+        qCritical("org.kde.krunner_llm is already running");
+        return 1;
+    }
+
+    return app.exec();
+}
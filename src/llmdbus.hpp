@@ -0,0 +1,87 @@
+#ifndef LLMDBUS_HPP
+#define LLMDBUS_HPP
+
+#include <QDBusArgument>
+#include <QDBusMetaType>
+#include <QList>
+#include <QString>
+#include <QVariantMap>
+
+namespace llm
+{
+
+    // Wire types of the org.kde.krunner1 interface
+    struct s_remote_match
+    {
+        QString id;
+        QString text;
+        QString icon_name;
+        // KRunner::QueryMatch::CategoryRelevance: 0 lowest to 100 highest
+        int category_relevance{ 0 };
+        double relevance{ 0.0 };
+        // "subtext", "actions", "multiline", ...
+        QVariantMap properties;
+    };
+
+    struct s_remote_action
+    {
+        QString id;
+        QString text;
+        QString icon_name;
+    };
+
+    using t_remote_matches = QList<s_remote_match>;
+    using t_remote_actions = QList<s_remote_action>;
+
+    inline auto operator<<(QDBusArgument &argument, const s_remote_match &match) -> QDBusArgument &
+    {
+        argument.beginStructure();
+        argument << match.id << match.text << match.icon_name << match.category_relevance << match.relevance << match.properties;
+        argument.endStructure();
+        return argument;
+    }
+
+    inline auto operator>>(const QDBusArgument &argument, s_remote_match &match) -> const QDBusArgument &
+    {
+        argument.beginStructure();
+        argument >> match.id >> match.text >> match.icon_name >> match.category_relevance >> match.relevance >> match.properties;
+        argument.endStructure();
+        return argument;
+    }
+
+    inline auto operator<<(QDBusArgument &argument, const s_remote_action &action) -> QDBusArgument &
+    {
+        argument.beginStructure();
+        argument << action.id << action.text << action.icon_name;
+        argument.endStructure();
+        return argument;
+    }
+
+    inline auto operator>>(const QDBusArgument &argument, s_remote_action &action) -> const QDBusArgument &
+    {
+        argument.beginStructure();
+        argument >> action.id >> action.text >> action.icon_name;
+        argument.endStructure();
+        return argument;
+    }
+
+} // namespace llm
+
+Q_DECLARE_METATYPE(llm::s_remote_match)
+Q_DECLARE_METATYPE(llm::s_remote_action)
+
+namespace llm
+{
+
+    // Must run before the runner object is exported
+    inline void register_dbus_types()
+    {
+        qDBusRegisterMetaType<s_remote_match>();
+        qDBusRegisterMetaType<t_remote_matches>();
+        qDBusRegisterMetaType<s_remote_action>();
+        qDBusRegisterMetaType<t_remote_actions>();
+    }
+
+} // namespace llm
+
+#endif // LLMDBUS_HPP
@@ -0,0 +1,573 @@
+#include "llmdiskcache.hpp"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace llm
+{
+
+    namespace
+    {
+        // File layout: file header of magic | u32 generation, then records of
+        //   u32 magic | u32 key length | u32 value length | u32 checksum | i64 written_at | key | value
+        // All integers are little endian.
+        constexpr QByteArrayView file_magic{ "KLLMCACHE\x01\0\0", 12 };
+        constexpr qint64 generation_offset = 12;
+        constexpr quint32 record_magic = 0x524d4c4b; // "KLMR"
+        constexpr qint64 file_header_size = 16;
+        constexpr qint64 record_header_size = 24;
+        constexpr qint64 min_compaction_size = 64 * 1024;
+        // Other processes hold the lock for one append or compaction at a time
+        constexpr int lock_timeout_ms = 250;
+
+        // Holds the cache's lock file for a scope, if it can be had in time
+        class c_lock_guard
+        {
+        public:
+            explicit c_lock_guard(QLockFile &lock)
+                : m_lock(lock), m_locked(lock.tryLock(lock_timeout_ms))
+            {
+            }
+            ~c_lock_guard()
+            {
+                if (m_locked)
+                {
+                    m_lock.unlock();
+                }
+            }
+
+            c_lock_guard(const c_lock_guard &) = delete;
+            auto operator=(const c_lock_guard &) -> c_lock_guard & = delete;
+
+            [[nodiscard]] auto locked() const -> bool
+            {
+                return m_locked;
+            }
+
+        private:
+            QLockFile &m_lock;
+            bool m_locked;
+        };
+
+        auto encode_header(quint32 generation) -> QByteArray
+        {
+            auto header = file_magic.toByteArray();
+            header.resize(file_header_size);
+            qToLittleEndian<quint32>(generation, header.data() + generation_offset);
+            return header;
+        }
+
+        auto checksum(QByteArrayView written_at, QByteArrayView key, QByteArrayView value) -> quint32
+        {
+            // FNV-1a; enough to tell a torn write from a complete one
+            quint32 hash = 2166136261U;
+            for (auto part : { written_at, key, value })
+            {
+                for (const char byte : part)
+                {
+                    hash ^= static_cast<quint8>(byte);
+                    hash *= 16777619U;
+                }
+            }
+            return hash;
+        }
+
+        auto encode_record(const QByteArray &key, const QByteArray &value, qint64 written_at) -> QByteArray
+        {
+            QByteArray record(record_header_size, Qt::Uninitialized);
+            auto *header = reinterpret_cast<uchar *>(record.data());
+            qToLittleEndian<quint32>(record_magic, header);
+            qToLittleEndian<quint32>(static_cast<quint32>(key.size()), header + 4);
+            qToLittleEndian<quint32>(static_cast<quint32>(value.size()), header + 8);
+            qToLittleEndian<qint64>(written_at, header + 16);
+            qToLittleEndian<quint32>(checksum(QByteArrayView(record).sliced(16, 8), key, value), header + 12);
+
+            record.append(key);
+            record.append(value);
+            return record;
+        }
+    } // namespace
+
+    c_disk_cache::c_disk_cache(QString path, qint64 max_bytes, std::chrono::seconds ttl)
+        : m_path(std::move(path)), m_max_bytes(max_bytes), m_ttl(ttl), m_lock(m_path + QStringLiteral(".lock"))
+    {
+    }
+
+    c_disk_cache::~c_disk_cache()
+    {
+        close();
+    }
+
+    auto c_disk_cache::default_path() -> QString
+    {
+        return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+               + QStringLiteral("/krunner-llm/answers.cache");
+    }
+
+    auto c_disk_cache::lookup(const QString &key) -> std::optional<QString>
+    {
+        if (!ensure_open())
+        {
+            return std::nullopt;
+        }
+
+        const auto key_bytes = key.toUtf8();
+        auto it = m_index.find(key_bytes);
+        if (it == m_index.end())
+        {
+            // Another process may have stored it since; its records are only read on a miss
+            if (m_file.size() <= m_scanned && !replaced())
+            {
+                return std::nullopt;
+            }
+            c_lock_guard lock(m_lock);
+            if (!lock.locked())
+            {
+                return std::nullopt;
+            }
+            refresh();
+            it = m_index.find(key_bytes);
+            if (it == m_index.end())
+            {
+                return std::nullopt;
+            }
+        }
+
+        const auto location = it.value();
+        if (is_expired(location))
+        {
+            m_live_bytes -= record_header_size + location.key_length + location.value_length;
+            m_index.erase(it);
+            return std::nullopt;
+        }
+
+        // Records appended since the last mapping are not visible yet
+        if (location.offset + record_header_size + location.key_length + location.value_length > m_mapped_size)
+        {
+            remap();
+            if (!m_map)
+            {
+                return std::nullopt;
+            }
+        }
+
+        const auto *value = reinterpret_cast<const char *>(m_map + location.offset + record_header_size + location.key_length);
+        return QString::fromUtf8(value, location.value_length);
+    }
+
+    void c_disk_cache::insert(const QString &key, const QString &response)
+    {
+        if (m_max_bytes <= 0 || !ensure_open())
+        {
+            return;
+        }
+
+        const auto key_bytes = key.toUtf8();
+        const auto value_bytes = response.toUtf8();
+        const auto written_at = QDateTime::currentSecsSinceEpoch();
+        const auto record = encode_record(key_bytes, value_bytes, written_at);
+
+        // A single record larger than the whole cache is not worth keeping
+        if (record.size() > m_max_bytes)
+        {
+            return;
+        }
+
+        // Dropping one answer beats blocking the caller on a busy lock
+        c_lock_guard lock(m_lock);
+        if (!lock.locked())
+        {
+            return;
+        }
+        refresh();
+        if (!m_file.isOpen())
+        {
+            return;
+        }
+
+        const auto offset = m_file.size();
+        if (!m_file.seek(offset) || m_file.write(record) != record.size() || !m_file.flush() || ::fdatasync(m_file.handle()) != 0)
+        {
+            // Leave the torn tail for scan() to truncate on the next open
+            close();
+            return;
+        }
+
+        if (auto it = m_index.constFind(key_bytes); it != m_index.cend())
+        {
+            m_live_bytes -= record_header_size + it->key_length + it->value_length;
+        }
+        m_index.insert(key_bytes, s_location{ .offset = offset,
+                                              .key_length = static_cast<quint32>(key_bytes.size()),
+                                              .value_length = static_cast<quint32>(value_bytes.size()),
+                                              .written_at = written_at });
+        m_live_bytes += record.size();
+        m_scanned = offset + record.size();
+
+        maybe_compact();
+    }
+
+    void c_disk_cache::compact()
+    {
+        if (!ensure_open())
+        {
+            return;
+        }
+
+        c_lock_guard lock(m_lock);
+        if (!lock.locked())
+        {
+            return;
+        }
+        refresh();
+        if (m_file.isOpen())
+        {
+            rewrite();
+        }
+    }
+
+    void c_disk_cache::rewrite()
+    {
+        if (m_mapped_size < m_file.size())
+        {
+            remap();
+        }
+        if (!m_map)
+        {
+            return;
+        }
+
+        // Keep the newest live records that fit in three quarters of the cap,
+        // so the next compaction is not triggered by the very next insert.
+        std::vector<s_location> live;
+        live.reserve(m_index.size());
+        for (const auto &location : std::as_const(m_index))
+        {
+            if (!is_expired(location))
+            {
+                live.push_back(location);
+            }
+        }
+        std::ranges::sort(live, [](const s_location &lhs, const s_location &rhs)
+                          { return lhs.written_at > rhs.written_at; });
+
+        const auto budget = m_max_bytes - (m_max_bytes / 4) - file_header_size;
+        qint64 used = 0;
+        std::vector<s_location> kept;
+        for (const auto &location : live)
+        {
+            const auto record_size = record_header_size + location.key_length + location.value_length;
+            if (used + record_size > budget)
+            {
+                continue;
+            }
+            used += record_size;
+            kept.push_back(location);
+        }
+
+        // Oldest first, so a later re-insert of a key still wins on the next scan
+        std::ranges::reverse(kept);
+
+        QSaveFile output(m_path);
+        if (!output.open(QIODevice::WriteOnly))
+        {
+            return;
+        }
+        // Counts the compactions the file has been through
+        output.write(encode_header(m_generation + 1));
+        for (const auto &location : kept)
+        {
+            const auto record_size = record_header_size + location.key_length + location.value_length;
+            output.write(reinterpret_cast<const char *>(m_map + location.offset), record_size);
+        }
+
+        // commit() renames over the old file atomically; a crash leaves either version intact
+        if (!output.commit())
+        {
+            return;
+        }
+
+        close();
+        static_cast<void>(open_file());
+    }
+
+    void c_disk_cache::set_limits(qint64 max_bytes, std::chrono::seconds ttl)
+    {
+        m_max_bytes = max_bytes;
+        m_ttl = ttl;
+        if (!m_file.isOpen())
+        {
+            return;
+        }
+
+        c_lock_guard lock(m_lock);
+        if (lock.locked())
+        {
+            refresh();
+            if (m_file.isOpen())
+            {
+                maybe_compact();
+            }
+        }
+    }
+
+    auto c_disk_cache::size() -> qsizetype
+    {
+        return ensure_open() ? m_index.size() : 0;
+    }
+
+    auto c_disk_cache::file_size() const -> qint64
+    {
+        return m_file.isOpen() ? m_file.size() : QFileInfo(m_path).size();
+    }
+
+    auto c_disk_cache::ensure_open() -> bool
+    {
+        if (m_file.isOpen())
+        {
+            return true;
+        }
+        if (m_open_attempted || m_max_bytes <= 0)
+        {
+            return false;
+        }
+
+        QDir().mkpath(QFileInfo(m_path).absolutePath());
+        c_lock_guard lock(m_lock);
+        if (!lock.locked())
+        {
+            // Busy elsewhere; the next use tries again
+            return false;
+        }
+        if (!open_file())
+        {
+            return false;
+        }
+        // Once open, a file closed after a failed write stays closed for this process
+        m_open_attempted = true;
+        return true;
+    }
+
+    auto c_disk_cache::open_file() -> bool
+    {
+        m_file.setFileName(m_path);
+        if (!m_file.open(QIODevice::ReadWrite))
+        {
+            return false;
+        }
+
+        // Start over if the file is new or not one of ours
+        const auto header = m_file.read(file_header_size);
+        if (header.size() < file_header_size || !header.startsWith(file_magic))
+        {
+            m_generation = 0;
+            if (!m_file.resize(0) || !m_file.seek(0) || m_file.write(encode_header(m_generation)) != file_header_size || !m_file.flush())
+            {
+                m_file.close();
+                return false;
+            }
+        }
+        else
+        {
+            m_generation = qFromLittleEndian<quint32>(header.constData() + generation_offset);
+        }
+
+        m_scanned = file_header_size;
+        remap();
+        scan();
+        maybe_compact();
+        return m_file.isOpen();
+    }
+
+    void c_disk_cache::refresh()
+    {
+        if (!m_file.isOpen())
+        {
+            return;
+        }
+
+        // Compacted or removed by another process: the open file is no longer the one at m_path
+        if (replaced())
+        {
+            close();
+            static_cast<void>(open_file());
+            return;
+        }
+        if (m_file.size() > m_scanned)
+        {
+            remap();
+            scan();
+        }
+    }
+
+    auto c_disk_cache::is_expired(const s_location &location) const -> bool
+    {
+        return QDateTime::currentSecsSinceEpoch() - location.written_at > m_ttl.count();
+    }
+
+    auto c_disk_cache::replaced() const -> bool
+    {
+        struct stat open_file{};
+        struct stat at_path{};
+        if (::fstat(m_file.handle(), &open_file) != 0 || ::stat(QFile::encodeName(m_path).constData(), &at_path) != 0)
+        {
+            return true;
+        }
+        return open_file.st_dev != at_path.st_dev || open_file.st_ino != at_path.st_ino;
+    }
+
+    void c_disk_cache::close()
+    {
+        if (m_map)
+        {
+            m_file.unmap(m_map);
+            m_map = nullptr;
+        }
+        m_mapped_size = 0;
+        m_scanned = 0;
+        m_file.close();
+        m_index.clear();
+        m_live_bytes = 0;
+    }
+
+    void c_disk_cache::remap()
+    {
+        if (m_map)
+        {
+            m_file.unmap(m_map);
+            m_map = nullptr;
+        }
+        m_mapped_size = m_file.size();
+        m_map = m_file.map(0, m_mapped_size);
+        if (!m_map)
+        {
+            m_mapped_size = 0;
+        }
+    }
+
+    auto c_disk_cache::read_record(qint64 offset) const -> std::optional<s_location>
+    {
+        if (offset + record_header_size > m_mapped_size)
+        {
+            return std::nullopt;
+        }
+
+        const uchar *header = m_map + offset;
+        if (qFromLittleEndian<quint32>(header) != record_magic)
+        {
+            return std::nullopt;
+        }
+
+        const auto key_length = qFromLittleEndian<quint32>(header + 4);
+        const auto value_length = qFromLittleEndian<quint32>(header + 8);
+        const auto stored_checksum = qFromLittleEndian<quint32>(header + 12);
+        const auto written_at = qFromLittleEndian<qint64>(header + 16);
+        if (offset + record_header_size + qint64(key_length) + qint64(value_length) > m_mapped_size)
+        {
+            return std::nullopt;
+        }
+
+        const auto *data = reinterpret_cast<const char *>(header);
+        const QByteArrayView key(data + record_header_size, key_length);
+        const QByteArrayView value(data + record_header_size + key_length, value_length);
+        if (checksum(QByteArrayView(data + 16, 8), key, value) != stored_checksum)
+        {
+            return std::nullopt;
+        }
+        return s_location{ .offset = offset, .key_length = key_length, .value_length = value_length, .written_at = written_at };
+    }
+
+    auto c_disk_cache::find_record(qint64 offset) const -> std::optional<qint64>
+    {
+        std::array<char, 4> magic{};
+        qToLittleEndian<quint32>(record_magic, magic.data());
+
+        const QByteArrayView mapped(reinterpret_cast<const char *>(m_map), m_mapped_size);
+        for (auto candidate = mapped.indexOf(QByteArrayView(magic), offset + 1); candidate >= 0; candidate = mapped.indexOf(QByteArrayView(magic), candidate + 1))
+        {
+            if (read_record(candidate))
+            {
+                return candidate;
+            }
+        }
+        return std::nullopt;
+    }
+
+    void c_disk_cache::scan()
+    {
+        if (!m_map)
+        {
+            return;
+        }
+
+        qint64 offset = m_scanned;
+        qint64 end = m_scanned;
+        while (offset + record_header_size <= m_mapped_size)
+        {
+            const auto location = read_record(offset);
+            if (!location)
+            {
+                // Torn by a crash while others appended after it: carry on at the next good record
+                const auto next = find_record(offset);
+                if (!next)
+                {
+                    break;
+                }
+                offset = *next;
+                continue;
+            }
+
+            const auto record_size = record_header_size + qint64(location->key_length) + qint64(location->value_length);
+            const auto key_bytes = QByteArray(reinterpret_cast<const char *>(m_map + offset + record_header_size), location->key_length);
+            if (auto it = m_index.constFind(key_bytes); it != m_index.cend())
+            {
+                m_live_bytes -= record_header_size + it->key_length + it->value_length;
+            }
+            m_index.insert(key_bytes, *location);
+            m_live_bytes += record_size;
+            offset += record_size;
+            end = offset;
+        }
+
+        m_scanned = end;
+
+        // Drop whatever a crash left half-written after the last good record
+        if (end < m_mapped_size)
+        {
+            m_file.unmap(m_map);
+            m_map = nullptr;
+            if (m_file.resize(end))
+            {
+                remap();
+            }
+            else
+            {
+                close();
+            }
+        }
+    }
+
+    void c_disk_cache::maybe_compact()
+    {
+        // A header-only file is as compact as it gets, whatever the cap
+        const auto size = m_file.size();
+        const bool over_cap = size > m_max_bytes && size > file_header_size;
+        const bool mostly_dead = size > min_compaction_size && (size - file_header_size - m_live_bytes) > m_live_bytes;
+        if (over_cap || mostly_dead)
+        {
+            rewrite();
+        }
+    }
+
+} // namespace llm
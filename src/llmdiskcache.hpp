@@ -0,0 +1,97 @@
+#ifndef LLMDISKCACHE_HPP
+#define LLMDISKCACHE_HPP
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QLockFile>
+#include <QString>
+
+#include <chrono>
+#include <optional>
+
+namespace llm
+{
+
+    // Persistent answer cache that survives krunner restarts.
+    //
+    // Entries are appended to a single memory-mapped file; a newer record for
+    // the same key supersedes the older one. Every record carries a checksum,
+    // so a record torn by a crash is detected and truncated on the next open.
+    // A torn record in the middle of the file, followed by other processes'
+    // appends, is skipped up to the next valid record. The file is only opened
+    // on first use and is compacted once it grows past its size cap or is
+    // mostly superseded records.
+    //
+    // Several processes may share the file (KRunner, plasmashell, the daemon).
+    // Appends, scans and compactions take a lock file next to it. A compaction
+    // renames a new file over the old one, so under the lock each process
+    // checks that its open file is still the one at the path and reopens the
+    // new one instead of appending to the replaced one.
+    class c_disk_cache
+    {
+    public:
+        c_disk_cache(QString path, qint64 max_bytes, std::chrono::seconds ttl);
+        ~c_disk_cache();
+
+        c_disk_cache(const c_disk_cache &) = delete;
+        auto operator=(const c_disk_cache &) -> c_disk_cache & = delete;
+
+        [[nodiscard]] static auto default_path() -> QString;
+
+        [[nodiscard]] auto lookup(const QString &key) -> std::optional<QString>;
+        void insert(const QString &key, const QString &response);
+        void compact();
+
+        void set_limits(qint64 max_bytes, std::chrono::seconds ttl);
+        [[nodiscard]] auto size() -> qsizetype;
+        [[nodiscard]] auto file_size() const -> qint64;
+
+    private:
+        struct s_location
+        {
+            qint64 offset;
+            quint32 key_length;
+            quint32 value_length;
+            qint64 written_at;
+        };
+
+        [[nodiscard]] auto is_expired(const s_location &location) const -> bool;
+        // Whether the open file was renamed over or removed since it was opened
+        [[nodiscard]] auto replaced() const -> bool;
+        // The complete record at `offset` of the mapping, if there is one
+        [[nodiscard]] auto read_record(qint64 offset) const -> std::optional<s_location>;
+        // Offset of the first complete record after `offset`
+        [[nodiscard]] auto find_record(qint64 offset) const -> std::optional<qint64>;
+        void close();
+        void remap();
+        // Opens the file under the lock on first use
+        [[nodiscard]] auto ensure_open() -> bool;
+
+        // The rest expect the lock to be held
+        [[nodiscard]] auto open_file() -> bool;
+        // Picks up records other processes appended, or their compacted file
+        void refresh();
+        void scan();
+        void maybe_compact();
+        void rewrite();
+
+        QString m_path;
+        qint64 m_max_bytes;
+        std::chrono::seconds m_ttl;
+        QLockFile m_lock;
+        QFile m_file;
+        // Bumped by every compaction and kept in the file header
+        quint32 m_generation{ 0 };
+        // End of the records scanned so far
+        qint64 m_scanned{ 0 };
+        uchar *m_map{ nullptr };
+        qint64 m_mapped_size{ 0 };
+        QHash<QByteArray, s_location> m_index;
+        qint64 m_live_bytes{ 0 };
+        bool m_open_attempted{ false };
+    };
+
+} // namespace llm
+
+#endif // LLMDISKCACHE_HPP
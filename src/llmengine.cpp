@@ -0,0 +1,605 @@
+#include "llmengine.hpp"
+#include "llmmetrics.hpp"
+#include <KLocalizedString>
+#include <QUrl>
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    // Questions kept for replay; older ones are dropped
+    constexpr qsizetype max_offline_queue = 8;
+} // namespace
+
+namespace llm
+{
+
+    auto describe(const s_error &error) -> s_error_text
+    {
+        switch (error.code)
+        {
+        case e_error_code::network_error:
+            return { .text = i18n("Network Error"), .subtext = error.message };
+        case e_error_code::invalid_api_key:
+            return { .text = i18n("API Key Error"), .subtext = i18n("Invalid or missing API key") };
+        case e_error_code::invalid_response:
+            return { .text = i18n("Invalid Response"), .subtext = error.message };
+        case e_error_code::timeout:
+            return { .text = i18n("Request Timeout"), .subtext = i18n("The answer took longer than the overall time budget") };
+        case e_error_code::rate_limited:
+            return { .text = i18n("Rate Limited"), .subtext = i18n("Too many requests, try again later") };
+        case e_error_code::connect_timeout:
+            return { .text = i18n("Server Unreachable"), .subtext = i18n("Could not connect to the server in time") };
+        case e_error_code::first_byte_timeout:
+            return { .text = i18n("Request Timeout"), .subtext = i18n("The server did not start answering in time") };
+        case e_error_code::idle_timeout:
+            return { .text = i18n("Response Stalled"), .subtext = i18n("The answer stopped arriving") };
+        }
+        return { .text = i18n("Network Error"), .subtext = error.message };
+    }
+
+    c_query_engine::c_query_engine(QObject *context, QString name, bool shows_progress)
+        : m_name(std::move(name))
+        , m_shows_progress(shows_progress)
+        , m_reachability(context, [this](bool online)
+                         { on_reachability_changed(online); })
+    {
+        m_cadence.restore(read_cadence_state());
+    }
+
+    c_query_engine::~c_query_engine()
+    {
+        write_cadence_state(m_cadence.state());
+        publish_latency();
+    }
+
+    void c_query_engine::apply(const s_settings &settings)
+    {
+        m_configured = is_configured(settings.primary);
+        // A D-Bus reply carries the whole answer, so there is nothing to stream into
+        m_streaming = settings.streaming && m_shows_progress;
+        m_adaptive_debounce = settings.adaptive_debounce;
+        m_debounce_delay = settings.debounce_delay;
+        m_replay_offline = settings.replay_offline;
+        if (!m_replay_offline)
+        {
+            m_offline_queue.clear();
+        }
+        m_cadence.set_bounds(settings.debounce_min, settings.debounce_max, settings.debounce_delay);
+        m_speculation.set_limit(settings.speculative_per_minute);
+        m_response_cache.set_limits(settings.cache_size, settings.cache_ttl);
+        m_session.set_limits(settings.session_turns, settings.session_timeout);
+        m_keep_alive = settings.keep_alive;
+        m_prewarm_interval = settings.prewarm_interval;
+        if (m_connection_pool)
+        {
+            m_connection_pool->set_keep_alive(m_keep_alive);
+            m_connection_pool->set_prewarm_interval(m_prewarm_interval);
+        }
+
+        // The disk cache is only opened by its first lookup, keeping startup cheap
+        if (m_disk_cache)
+        {
+            m_disk_cache->set_limits(settings.disk_cache_bytes, settings.disk_cache_ttl);
+        }
+        else
+        {
+            m_disk_cache = std::make_unique<c_disk_cache>(c_disk_cache::default_path(), settings.disk_cache_bytes, settings.disk_cache_ttl);
+        }
+
+        // A changed draft model only needs a new client when reconfiguring in place is not enough.
+        // Done before the providers, so the requests they send again ask the current draft model.
+        m_draft_config = m_shows_progress ? settings.draft : std::nullopt;
+        m_skip_upgrade_when_used = settings.skip_upgrade_when_used;
+        if (m_draft_client && (!m_draft_config || !m_draft_client->reconfigure(*m_draft_config)))
+        {
+            for (auto &entry : m_in_flight)
+            {
+                entry.draft_handle.cancel();
+            }
+            m_draft_client.reset();
+        }
+
+        std::vector<s_config> configs{ settings.primary };
+        configs.insert(configs.end(), settings.fallbacks.begin(), settings.fallbacks.end());
+        m_router.set_rules(settings.routing.fast_pattern, settings.routing.strong_pattern);
+        const auto kept = m_providers.apply(configs, settings.failure_threshold, settings.cooldown, settings.hedge, settings.routing.profiles);
+
+        // Requests on a client about to be dropped are cancelled and sent again below
+        QList<s_in_flight> orphaned;
+        for (auto it = m_in_flight.begin(); it != m_in_flight.end();)
+        {
+            if (it->provider < kept.size() && kept[it->provider])
+            {
+                ++it;
+                continue;
+            }
+            it->handle.cancel();
+            it->draft_handle.cancel();
+            orphaned.append(std::move(*it));
+            it = m_in_flight.erase(it);
+        }
+
+        for (auto &entry : orphaned)
+        {
+            resubmit(std::move(entry));
+        }
+    }
+
+    auto c_query_engine::configured() const -> bool
+    {
+        return m_configured;
+    }
+
+    void c_query_engine::record_keystroke(const QString &prompt)
+    {
+        // A front end may ask again about an unchanged query; that is not a keystroke
+        if (prompt == m_last_typed_prompt)
+        {
+            return;
+        }
+        m_last_typed_prompt = prompt;
+        ++m_stats.keystrokes;
+
+        const auto samples = m_cadence.state().samples;
+        m_cadence.record_keystroke(c_typing_cadence::t_clock::now());
+        if (m_cadence.state().samples != samples && m_cadence.state().samples % 50 == 0)
+        {
+            write_cadence_state(m_cadence.state());
+        }
+    }
+
+    auto c_query_engine::debounce_delay() const -> std::chrono::milliseconds
+    {
+        return m_adaptive_debounce ? m_cadence.delay() : m_debounce_delay;
+    }
+
+    void c_query_engine::record_debounce(const QString &prompt, std::chrono::steady_clock::duration waited)
+    {
+        // Not the slot a request would take: that asks the breaker and may use up a half-open probe
+        m_providers.client(m_providers.routed(m_router.classify(prompt).tier)).metrics().record(e_phase::debounce, waited);
+    }
+
+    void c_query_engine::prewarm()
+    {
+        // Unix sockets have nothing worth warming up, and offline there is nothing to reach
+        if (m_reachability.is_online() && !m_providers.client().local_socket())
+        {
+            connection_pool()->prewarm(QUrl(m_providers.client().get_endpoint(m_streaming)));
+        }
+    }
+
+    auto c_query_engine::connection_pool() -> std::shared_ptr<c_connection_pool>
+    {
+        // Created lazily so the network manager lives in the thread running the queries
+        if (!m_connection_pool)
+        {
+            m_connection_pool = std::make_shared<c_connection_pool>();
+            m_connection_pool->set_keep_alive(m_keep_alive);
+            m_connection_pool->set_prewarm_interval(m_prewarm_interval);
+        }
+        return m_connection_pool;
+    }
+
+    auto c_query_engine::cache_key(const QString &prompt) -> QString
+    {
+        // Each tier's model answers differently, so the key is that of the model the question is routed to
+        return c_response_cache::make_key(m_providers.routed_config(m_router.classify(prompt).tier), m_session.history(), prompt);
+    }
+
+    auto c_query_engine::cached_response(const QString &key) -> std::optional<QString>
+    {
+        auto response = m_response_cache.lookup(key);
+        if (!response.has_value())
+        {
+            // Answers from earlier sessions are promoted back into memory
+            response = m_disk_cache->lookup(key);
+            if (response.has_value())
+            {
+                m_response_cache.insert(key, *response);
+            }
+        }
+        if (response.has_value())
+        {
+            ++m_stats.cache_hits;
+        }
+        return response;
+    }
+
+    auto c_query_engine::unreachable() const -> bool
+    {
+        return !m_reachability.is_online() && !m_providers.serves_offline();
+    }
+
+    auto c_query_engine::replays_offline() const -> bool
+    {
+        return m_replay_offline;
+    }
+
+    void c_query_engine::queue_offline(const QString &prompt, QList<s_waiter> waiters)
+    {
+        if (!m_replay_offline)
+        {
+            return;
+        }
+
+        // While typing or deleting, the latest edit of a question replaces the earlier ones
+        m_offline_queue.removeIf([&prompt](const s_in_flight &queued)
+                                 { return prompt.startsWith(queued.prompt) || queued.prompt.startsWith(prompt); });
+        s_in_flight queued;
+        queued.waiters = std::move(waiters);
+        queued.prompt = prompt;
+        queued.history = m_session.history();
+        m_offline_queue.append(std::move(queued));
+        while (m_offline_queue.size() > max_offline_queue)
+        {
+            m_offline_queue.removeFirst();
+        }
+    }
+
+    void c_query_engine::on_reachability_changed(bool online)
+    {
+        if (!online)
+        {
+            return;
+        }
+
+        // Answers to questions asked offline land in the cache, and with whoever still waits for them
+        const auto now = std::chrono::steady_clock::now();
+        auto queued = std::exchange(m_offline_queue, {});
+        for (auto &entry : queued)
+        {
+            entry.started = now;
+            resubmit(std::move(entry));
+        }
+    }
+
+    auto c_query_engine::speculate(const QString &prompt) -> bool
+    {
+        // Joining a request already on the wire costs nothing from the budget
+        if (!m_speculation.looks_complete(prompt))
+        {
+            return false;
+        }
+        if (m_in_flight.contains(cache_key(prompt)))
+        {
+            return true;
+        }
+        if (!m_speculation.try_acquire())
+        {
+            return false;
+        }
+        ++m_stats.speculative;
+        return true;
+    }
+
+    void c_query_engine::ask(const QString &prompt, s_waiter waiter)
+    {
+        const auto key = cache_key(prompt);
+
+        // Single-flight: a second query for the same prompt joins the reply already on the wire
+        if (auto it = m_in_flight.find(key); it != m_in_flight.end())
+        {
+            ++m_stats.joined;
+            if (!it->draft.isEmpty())
+            {
+                waiter.answer(it->draft, e_answer::draft);
+            }
+            else if (!it->partial_answer.isEmpty())
+            {
+                waiter.answer(it->partial_answer, e_answer::partial);
+            }
+            it->waiters.append(std::move(waiter));
+            return;
+        }
+
+        auto &in_flight = m_in_flight[key];
+        in_flight.waiters.append(std::move(waiter));
+        in_flight.prompt = prompt;
+        in_flight.history = m_session.history();
+        in_flight.started = std::chrono::steady_clock::now();
+        in_flight.route = m_router.classify(prompt);
+
+        auto provider = choose_provider(in_flight, !m_reachability.is_online());
+        if (!provider.has_value())
+        {
+            finish_request(key, m_providers.size(), std::unexpected(s_error{ .code = e_error_code::network_error, .message = i18n("All providers are currently unavailable") }));
+            return;
+        }
+        dispatch(key, *provider);
+        start_draft(key);
+    }
+
+    auto c_query_engine::waiting(const QString &prompt, const QString &owner) -> bool
+    {
+        const auto it = m_in_flight.constFind(cache_key(prompt));
+        return it != m_in_flight.cend() && std::ranges::any_of(it->waiters, [&owner](const s_waiter &waiter)
+                                                                { return waiter.owner == owner; });
+    }
+
+    void c_query_engine::detach(const QString &owner, bool keep_running)
+    {
+        for (auto it = m_in_flight.begin(); it != m_in_flight.end();)
+        {
+            const auto removed = it->waiters.removeIf([&owner](const s_waiter &waiter)
+                                                      { return waiter.owner == owner; });
+            if (removed > 0 && it->waiters.isEmpty() && !keep_running)
+            {
+                cancel(*it);
+                it = m_in_flight.erase(it);
+                continue;
+            }
+            ++it;
+        }
+    }
+
+    void c_query_engine::cancel_superseded(const QString &current_key)
+    {
+        // Abort replies for prompts the user has typed past; they would only burn tokens
+        for (auto it = m_in_flight.begin(); it != m_in_flight.end();)
+        {
+            if (it.key() == current_key)
+            {
+                ++it;
+                continue;
+            }
+            cancel(*it);
+            it = m_in_flight.erase(it);
+        }
+    }
+
+    void c_query_engine::cancel(s_in_flight &entry)
+    {
+        entry.handle.cancel();
+        entry.draft_handle.cancel();
+        if (entry.probe)
+        {
+            m_providers.release_probe(entry.provider);
+        }
+        ++m_stats.cancelled;
+    }
+
+    void c_query_engine::take_answer(const QString &prompt, const QString &answer)
+    {
+        // An answer the user took is context for the follow-up questions
+        m_session.add_turn(prompt, answer);
+
+        // The draft was good enough: stop paying for the stronger answer
+        if (!m_skip_upgrade_when_used)
+        {
+            return;
+        }
+        for (auto it = m_in_flight.begin(); it != m_in_flight.end(); ++it)
+        {
+            if (!it->draft.isEmpty() && it->draft == answer)
+            {
+                cancel(*it);
+                m_in_flight.erase(it);
+                return;
+            }
+        }
+    }
+
+    void c_query_engine::resubmit(s_in_flight entry)
+    {
+        // The route and the cache key may have changed with the configuration, so re-key before joining
+        entry.route = m_router.classify(entry.prompt);
+        const auto key = c_response_cache::make_key(m_providers.routed_config(entry.route.tier), entry.history, entry.prompt);
+        if (auto it = m_in_flight.find(key); it != m_in_flight.end())
+        {
+            it->waiters.append(entry.waiters);
+            return;
+        }
+
+        const auto provider = choose_provider(entry, !m_reachability.is_online());
+        const bool has_draft = !entry.draft.isEmpty();
+        m_in_flight.insert(key, std::move(entry));
+        if (provider)
+        {
+            dispatch(key, *provider);
+            // A draft already shown stays until the new request answers
+            if (!has_draft)
+            {
+                start_draft(key);
+            }
+        }
+        else
+        {
+            finish_request(key, m_providers.size(), std::unexpected(s_error{ .code = e_error_code::network_error, .message = i18n("All providers are currently unavailable") }));
+        }
+    }
+
+    auto c_query_engine::choose_provider(const s_in_flight &entry, bool offline) -> std::optional<std::size_t>
+    {
+        if (auto profile = m_providers.profile(entry.route.tier, offline))
+        {
+            return profile;
+        }
+        return m_providers.next_available(0, offline);
+    }
+
+    void c_query_engine::dispatch(const QString &key, std::size_t provider)
+    {
+        auto it = m_in_flight.find(key);
+        if (it == m_in_flight.end())
+        {
+            return;
+        }
+        it->provider = provider;
+        it->probe = m_providers.probing(provider);
+        it->partial_answer.clear();
+        ++m_stats.dispatched;
+
+        // Answers are delivered from the reply callbacks; no thread waits for the network
+        auto on_finished = [this, key, provider](t_result result)
+        {
+            finish_request(key, provider, std::move(result));
+        };
+
+        if (!m_streaming)
+        {
+            it->handle = m_providers.client(provider).send_message_async(it->history, it->prompt, std::move(on_finished));
+            return;
+        }
+
+        // Grow the shown answer while tokens arrive
+        auto on_chunk = [this, key](const QString &chunk)
+        {
+            auto it = m_in_flight.find(key);
+            if (it == m_in_flight.end())
+            {
+                return;
+            }
+
+            it->partial_answer.append(chunk);
+
+            // A complete draft reads better than the start of the main answer
+            if (!it->draft.isEmpty())
+            {
+                return;
+            }
+            for (const auto &waiter : std::as_const(it->waiters))
+            {
+                waiter.answer(it->partial_answer, e_answer::partial);
+            }
+        };
+        it->handle = m_providers.client(provider).send_message_stream(it->history, it->prompt, std::move(on_chunk), std::move(on_finished));
+    }
+
+    void c_query_engine::start_draft(const QString &key)
+    {
+        auto it = m_in_flight.find(key);
+        if (!m_draft_config || it == m_in_flight.end())
+        {
+            return;
+        }
+        if (!m_reachability.is_online() && needs_network(*m_draft_config))
+        {
+            return;
+        }
+
+        if (!m_draft_client)
+        {
+            m_draft_client = std::make_unique<c_client>(*m_draft_config, connection_pool());
+        }
+        it->draft_handle = m_draft_client->send_message_async(it->history, it->prompt, [this, key](t_result result)
+                                                              { finish_draft(key, std::move(result)); });
+    }
+
+    void c_query_engine::finish_draft(const QString &key, t_result result)
+    {
+        // A failed draft changes nothing, and one beaten by the main answer's first tokens is not shown
+        auto it = m_in_flight.find(key);
+        if (it == m_in_flight.end() || !result.has_value() || !it->partial_answer.isEmpty())
+        {
+            return;
+        }
+
+        it->draft = result.value();
+        ++m_stats.drafts;
+        for (const auto &waiter : std::as_const(it->waiters))
+        {
+            waiter.answer(it->draft, e_answer::draft);
+        }
+    }
+
+    void c_query_engine::finish_request(const QString &key, std::size_t provider, t_result result)
+    {
+        if (provider < m_providers.size())
+        {
+            auto &breaker = m_providers.breaker(provider);
+            if (result.has_value())
+            {
+                breaker.record_success();
+            }
+            else if (result.error().code == e_error_code::invalid_api_key)
+            {
+                // A rejected key says nothing about the provider's health and is the user's to fix,
+                // so it neither opens the breaker nor hides behind a fallback
+                if (const auto it = m_in_flight.constFind(key); it != m_in_flight.cend() && it->probe)
+                {
+                    m_providers.release_probe(provider);
+                }
+            }
+            else
+            {
+                breaker.record_failure();
+
+                // Reroute to the next healthy provider instead of surfacing the error
+                if (auto next = m_providers.next_fallback(provider, !m_reachability.is_online()))
+                {
+                    dispatch(key, *next);
+                    return;
+                }
+            }
+        }
+
+        auto in_flight = m_in_flight.take(key);
+        in_flight.draft_handle.cancel();
+        if (provider < m_providers.size())
+        {
+            const auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - in_flight.started);
+            c_router::log(in_flight.route, m_providers.config(provider), latency, result.has_value());
+        }
+
+        // A draft beats an error: the main model failing leaves the quick answer standing,
+        // though it is not cached as the answer to the question
+        const bool draft_only = !result.has_value() && !in_flight.draft.isEmpty();
+        if (draft_only)
+        {
+            result = in_flight.draft;
+        }
+
+        if (result.has_value() && !draft_only)
+        {
+            // A failover answer is kept under its own model's key, not the routed one's
+            const auto answered_key = provider < m_providers.size() ? c_response_cache::make_key(m_providers.config(provider), in_flight.history, in_flight.prompt) : key;
+            store_response(answered_key, result.value());
+        }
+
+        const auto delivering = std::chrono::steady_clock::now();
+        ++m_stats.completed;
+        for (const auto &waiter : std::as_const(in_flight.waiters))
+        {
+            const bool delivered = result.has_value() ? waiter.answer(result.value(), e_answer::complete) : waiter.fail(result.error());
+            if (!delivered)
+            {
+                // The front end moved on to another query before the answer arrived
+                ++m_stats.stale_contexts;
+            }
+        }
+
+        if (result.has_value() && !draft_only && provider < m_providers.size())
+        {
+            const auto delivered = std::chrono::steady_clock::now();
+            auto &metrics = m_providers.client(provider).metrics();
+            metrics.record(e_phase::deliver, delivered - delivering);
+            metrics.record(e_phase::total, delivered - in_flight.started);
+
+            if (++m_completed_queries % 20 == 0)
+            {
+                publish_latency();
+            }
+        }
+    }
+
+    void c_query_engine::store_response(const QString &cache_key, const QString &response)
+    {
+        m_response_cache.insert(cache_key, response);
+        m_disk_cache->insert(cache_key, response);
+    }
+
+    auto c_query_engine::stats() const -> const s_stats &
+    {
+        return m_stats;
+    }
+
+    void c_query_engine::publish_latency() const
+    {
+        const auto &registry = c_latency_registry::instance();
+        qCInfo(LLM_LATENCY).noquote() << registry.report();
+        registry.write_stats(c_latency_registry::default_stats_path(m_name));
+    }
+
+} // namespace llm
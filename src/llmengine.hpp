@@ -0,0 +1,199 @@
+#ifndef LLMENGINE_HPP
+#define LLMENGINE_HPP
+
+#include "llmcache.hpp"
+#include "llmcadence.hpp"
+#include "llmclient.hpp"
+#include "llmconnectionpool.hpp"
+#include "llmdiskcache.hpp"
+#include "llmproviderchain.hpp"
+#include "llmreachability.hpp"
+#include "llmrouter.hpp"
+#include "llmsession.hpp"
+#include "llmsettings.hpp"
+#include "llmspeculation.hpp"
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+
+namespace llm
+{
+
+    // What a match telling the user about a failed question shows
+    struct s_error_text
+    {
+        QString text;
+        QString subtext;
+    };
+
+    [[nodiscard]] auto describe(const s_error &error) -> s_error_text;
+
+    // Everything between a typed question and its answer that the runner
+    // plugin and the D-Bus daemon share: caches, routing, single-flight
+    // requests, failover, circuit breakers, cascade drafts and the offline
+    // queue. The front ends only debounce, show matches and hold replies.
+    class c_query_engine
+    {
+    public:
+        enum class e_answer : std::uint8_t
+        {
+            complete,
+            partial,
+            draft
+        };
+
+        // One query waiting for an answer: a KRunner context, a held D-Bus call, ...
+        struct s_waiter
+        {
+            // Lets detach() find the waiter again; may be empty
+            QString owner;
+            // Both return false when nobody was left to show the answer to
+            std::function<bool(const QString &answer, e_answer kind)> answer;
+            std::function<bool(const s_error &error)> fail;
+        };
+
+        // Counters for judging debounce, caching and cancellation against real typing
+        struct s_stats
+        {
+            qint64 keystrokes{ 0 };
+            qint64 cache_hits{ 0 };
+            // Requests sent to a provider, failover retries included
+            qint64 dispatched{ 0 };
+            // Requests sent before the debounce ran out because the prompt looked finished
+            qint64 speculative{ 0 };
+            // Cascade drafts shown before the main answer
+            qint64 drafts{ 0 };
+            // Queries answered by a request that was already in flight
+            qint64 joined{ 0 };
+            // Requests aborted because nobody waited for them any more
+            qint64 cancelled{ 0 };
+            qint64 completed{ 0 };
+            // Answers that arrived after the front end had moved on to another query
+            qint64 stale_contexts{ 0 };
+        };
+
+        // Callbacks run in `context`'s thread. `name` tells the front ends' latency
+        // stats files apart. Only a front end that can update an answer it shows
+        // gets streamed partial answers and cascade drafts.
+        c_query_engine(QObject *context, QString name, bool shows_progress);
+        ~c_query_engine();
+
+        c_query_engine(const c_query_engine &) = delete;
+        auto operator=(const c_query_engine &) -> c_query_engine & = delete;
+
+        // Caches and untouched clients survive; requests on a replaced client are sent again
+        void apply(const s_settings &settings);
+        [[nodiscard]] auto configured() const -> bool;
+
+        void record_keystroke(const QString &prompt);
+        // The adaptive delay when enabled, the configured one otherwise
+        [[nodiscard]] auto debounce_delay() const -> std::chrono::milliseconds;
+        // Counted against the provider `prompt` is routed to
+        void record_debounce(const QString &prompt, std::chrono::steady_clock::duration waited);
+        // Gets DNS, TCP and TLS out of the way while a question is being typed
+        void prewarm();
+
+        // Cache and single-flight key of `prompt` asked in the current session
+        [[nodiscard]] auto cache_key(const QString &prompt) -> QString;
+        [[nodiscard]] auto cached_response(const QString &key) -> std::optional<QString>;
+        // Offline with no provider on this machine: asking would only wait for a timeout
+        [[nodiscard]] auto unreachable() const -> bool;
+        [[nodiscard]] auto replays_offline() const -> bool;
+        // Keeps the question for when the network is back, if replay is on
+        void queue_offline(const QString &prompt, QList<s_waiter> waiters = {});
+        // Whether a finished-looking question may skip the debounce
+        [[nodiscard]] auto speculate(const QString &prompt) -> bool;
+
+        // Joins the request on the wire for `prompt`, or sends one
+        void ask(const QString &prompt, s_waiter waiter);
+        [[nodiscard]] auto waiting(const QString &prompt, const QString &owner) -> bool;
+        // Drops the owner's waiters; a request nobody waits for any more is
+        // cancelled unless `keep_running`, which lets its answer reach the cache
+        void detach(const QString &owner, bool keep_running = false);
+        // Aborts every request but the one for `current_key`
+        void cancel_superseded(const QString &current_key);
+        // The user took `answer`: it continues the session, and a draft taken ends its upgrade
+        void take_answer(const QString &prompt, const QString &answer);
+
+        [[nodiscard]] auto stats() const -> const s_stats &;
+        // Logs the phase percentiles to LLM_LATENCY and refreshes the stats file
+        void publish_latency() const;
+
+    private:
+        // A reply on the wire and every query waiting for it
+        struct s_in_flight
+        {
+            c_request_handle handle;
+            QList<s_waiter> waiters;
+            QString partial_answer;
+            // The fast model's answer, shown until the main one replaces it
+            c_request_handle draft_handle;
+            QString draft;
+            QString prompt;
+            // Session turns the prompt was asked after
+            QList<s_message> history;
+            // Index into m_providers of the provider currently answering
+            std::size_t provider{ 0 };
+            // Sent as that provider's half-open probe, whose slot a cancel has to give back
+            bool probe{ false };
+            s_route route;
+            std::chrono::steady_clock::time_point started;
+        };
+
+        [[nodiscard]] auto connection_pool() -> std::shared_ptr<c_connection_pool>;
+        // Sends a request again under the current configuration, joining an equal one on the wire
+        void resubmit(s_in_flight entry);
+        void on_reachability_changed(bool online);
+        // The tier's routing profile if it has one, the failover list otherwise
+        [[nodiscard]] auto choose_provider(const s_in_flight &entry, bool offline) -> std::optional<std::size_t>;
+        void dispatch(const QString &key, std::size_t provider);
+        // Asks the cascade's fast model alongside the main request
+        void start_draft(const QString &key);
+        void finish_draft(const QString &key, t_result result);
+        void finish_request(const QString &key, std::size_t provider, t_result result);
+        void cancel(s_in_flight &entry);
+        void store_response(const QString &cache_key, const QString &response);
+
+        QString m_name;
+        bool m_shows_progress;
+        bool m_configured{ false };
+        bool m_streaming{ true };
+        bool m_adaptive_debounce{ true };
+        std::chrono::milliseconds m_debounce_delay{ 800 };
+        bool m_replay_offline{ false };
+        c_typing_cadence m_cadence{ std::chrono::milliseconds(250), std::chrono::milliseconds(1500), std::chrono::milliseconds(800) };
+        QString m_last_typed_prompt;
+        c_speculation m_speculation{ 6 };
+        std::chrono::seconds m_keep_alive{ 120 };
+        std::chrono::seconds m_prewarm_interval{ 30 };
+        qint64 m_completed_queries{ 0 };
+        s_stats m_stats;
+        std::shared_ptr<c_connection_pool> m_connection_pool;
+        c_router m_router;
+        // The configured provider first, then the fallbacks and the routing profiles
+        c_provider_chain m_providers{ [this]()
+                                      { return connection_pool(); } };
+        std::optional<s_config> m_draft_config;
+        bool m_skip_upgrade_when_used{ true };
+        std::unique_ptr<c_client> m_draft_client;
+        // Keyed like the response cache, so equal prompts share one reply
+        QHash<QString, s_in_flight> m_in_flight;
+        c_response_cache m_response_cache{ 64, std::chrono::hours(1) };
+        std::unique_ptr<c_disk_cache> m_disk_cache;
+        c_session m_session{ 4, std::chrono::minutes(5) };
+        // Questions typed while offline, oldest first, waiting for the network to return
+        QList<s_in_flight> m_offline_queue;
+        c_reachability m_reachability;
+    };
+
+} // namespace llm
+
+#endif // LLMENGINE_HPP
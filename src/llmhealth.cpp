@@ -0,0 +1,74 @@
+#include "llmhealth.hpp"
+
+#include <algorithm>
+
+namespace llm
+{
+
+    c_circuit_breaker::c_circuit_breaker(int failure_threshold, std::chrono::milliseconds cooldown)
+        : m_failure_threshold(std::max(failure_threshold, 1)), m_cooldown(cooldown)
+    {
+    }
+
+    auto c_circuit_breaker::allow_request(t_clock::time_point now) -> bool
+    {
+        switch (m_state)
+        {
+        case e_breaker_state::closed:
+            return true;
+        case e_breaker_state::open:
+            if (now - m_opened_at < m_cooldown)
+            {
+                return false;
+            }
+            m_state = e_breaker_state::half_open;
+            m_probe_in_flight = true;
+            return true;
+        case e_breaker_state::half_open:
+            // Only one probe at a time; everyone else keeps skipping the provider
+            if (m_probe_in_flight)
+            {
+                return false;
+            }
+            m_probe_in_flight = true;
+            return true;
+        }
+        return false;
+    }
+
+    void c_circuit_breaker::record_success()
+    {
+        m_state = e_breaker_state::closed;
+        m_consecutive_failures = 0;
+        m_probe_in_flight = false;
+    }
+
+    void c_circuit_breaker::record_failure(t_clock::time_point now)
+    {
+        m_probe_in_flight = false;
+        ++m_consecutive_failures;
+
+        if (m_state == e_breaker_state::half_open || m_consecutive_failures >= m_failure_threshold)
+        {
+            m_state = e_breaker_state::open;
+            m_opened_at = now;
+        }
+    }
+
+    void c_circuit_breaker::release_probe()
+    {
+        m_probe_in_flight = false;
+    }
+
+    void c_circuit_breaker::set_limits(int failure_threshold, std::chrono::milliseconds cooldown)
+    {
+        m_failure_threshold = std::max(failure_threshold, 1);
+        m_cooldown = cooldown;
+    }
+
+    auto c_circuit_breaker::state() const -> e_breaker_state
+    {
+        return m_state;
+    }
+
+} // namespace llm
@@ -0,0 +1,49 @@
+#ifndef LLMHEALTH_HPP
+#define LLMHEALTH_HPP
+
+#include <chrono>
+#include <cstdint>
+
+namespace llm
+{
+
+    enum class e_breaker_state : std::uint8_t
+    {
+        closed,
+        open,
+        half_open
+    };
+
+    // Per-provider circuit breaker. After `failure_threshold` consecutive
+    // failures the breaker opens and requests skip the provider; once the
+    // cooldown has passed a single probe request is let through, and its
+    // outcome closes or re-opens the breaker.
+    class c_circuit_breaker
+    {
+    public:
+        using t_clock = std::chrono::steady_clock;
+
+        explicit c_circuit_breaker(int failure_threshold = 3, std::chrono::milliseconds cooldown = std::chrono::seconds(30));
+
+        // Claims the half-open probe slot when it grants a request in that state
+        [[nodiscard]] auto allow_request(t_clock::time_point now = t_clock::now()) -> bool;
+        void record_success();
+        void record_failure(t_clock::time_point now = t_clock::now());
+        // For a request cancelled before its outcome was known; the next request probes instead
+        void release_probe();
+
+        void set_limits(int failure_threshold, std::chrono::milliseconds cooldown);
+        [[nodiscard]] auto state() const -> e_breaker_state;
+
+    private:
+        int m_failure_threshold;
+        std::chrono::milliseconds m_cooldown;
+        e_breaker_state m_state{ e_breaker_state::closed };
+        int m_consecutive_failures{ 0 };
+        t_clock::time_point m_opened_at;
+        bool m_probe_in_flight{ false };
+    };
+
+} // namespace llm
+
+#endif // LLMHEALTH_HPP
@@ -0,0 +1,361 @@
+#include "llmjson.hpp"
+
+#include <algorithm>
+
+namespace llm
+{
+
+    namespace
+    {
+        class c_json_cursor
+        {
+        public:
+            explicit c_json_cursor(QByteArrayView json)
+                : m_json(json)
+            {
+            }
+
+            void skip_whitespace()
+            {
+                while (m_pos < m_json.size())
+                {
+                    const char c = m_json[m_pos];
+                    if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                    {
+                        return;
+                    }
+                    ++m_pos;
+                }
+            }
+
+            // Consumes `c` after optional whitespace
+            [[nodiscard]] auto accept(char c) -> bool
+            {
+                skip_whitespace();
+                if (m_pos < m_json.size() && m_json[m_pos] == c)
+                {
+                    ++m_pos;
+                    return true;
+                }
+                return false;
+            }
+
+            // Reads a string literal and returns its still-escaped body
+            [[nodiscard]] auto read_string() -> std::optional<QByteArrayView>
+            {
+                if (!accept('"'))
+                {
+                    return std::nullopt;
+                }
+
+                const auto start = m_pos;
+                while (m_pos < m_json.size())
+                {
+                    const char c = m_json[m_pos];
+                    if (c == '\\')
+                    {
+                        m_pos += 2;
+                        continue;
+                    }
+                    if (c == '"')
+                    {
+                        return m_json.sliced(start, m_pos++ - start);
+                    }
+                    ++m_pos;
+                }
+                return std::nullopt;
+            }
+
+            // Skips one value of any type; containers are skipped by bracket depth
+            // without validating their contents
+            [[nodiscard]] auto skip_value() -> bool
+            {
+                skip_whitespace();
+                if (m_pos >= m_json.size())
+                {
+                    return false;
+                }
+
+                const char first = m_json[m_pos];
+                if (first == '"')
+                {
+                    return read_string().has_value();
+                }
+
+                if (first == '{' || first == '[')
+                {
+                    int depth = 0;
+                    while (m_pos < m_json.size())
+                    {
+                        const char c = m_json[m_pos];
+                        if (c == '"')
+                        {
+                            if (!read_string())
+                            {
+                                return false;
+                            }
+                            continue;
+                        }
+                        ++m_pos;
+                        if (c == '{' || c == '[')
+                        {
+                            ++depth;
+                        }
+                        else if ((c == '}' || c == ']') && --depth == 0)
+                        {
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+
+                // Number, true, false or null
+                const auto start = m_pos;
+                while (m_pos < m_json.size())
+                {
+                    const char c = m_json[m_pos];
+                    if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t')
+                    {
+                        break;
+                    }
+                    ++m_pos;
+                }
+                return m_pos > start;
+            }
+
+            // Positions the cursor on the value of member `key` of the object at the cursor
+            [[nodiscard]] auto enter_member(QByteArrayView key) -> bool
+            {
+                if (!accept('{'))
+                {
+                    return false;
+                }
+                if (accept('}'))
+                {
+                    return false;
+                }
+
+                for (;;)
+                {
+                    auto name = read_string();
+                    if (!name || !accept(':'))
+                    {
+                        return false;
+                    }
+                    // Member names on our paths never contain escapes
+                    if (*name == key)
+                    {
+                        return true;
+                    }
+                    if (!skip_value() || !accept(','))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            // Positions the cursor on element `index` of the array at the cursor
+            [[nodiscard]] auto enter_element(qsizetype index) -> bool
+            {
+                if (!accept('['))
+                {
+                    return false;
+                }
+                if (accept(']'))
+                {
+                    return false;
+                }
+
+                for (qsizetype current = 0; current < index; ++current)
+                {
+                    if (!skip_value() || !accept(','))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        private:
+            QByteArrayView m_json;
+            qsizetype m_pos{ 0 };
+        };
+
+        auto hex_value(QByteArrayView digits) -> std::optional<char16_t>
+        {
+            if (digits.size() != 4)
+            {
+                return std::nullopt;
+            }
+
+            char16_t value = 0;
+            for (const char c : digits)
+            {
+                value <<= 4;
+                if (c >= '0' && c <= '9')
+                {
+                    value |= static_cast<char16_t>(c - '0');
+                }
+                else if (c >= 'a' && c <= 'f')
+                {
+                    value |= static_cast<char16_t>(c - 'a' + 10);
+                }
+                else if (c >= 'A' && c <= 'F')
+                {
+                    value |= static_cast<char16_t>(c - 'A' + 10);
+                }
+                else
+                {
+                    return std::nullopt;
+                }
+            }
+            return value;
+        }
+    } // namespace
+
+    auto extract_json_string(QByteArrayView json, QByteArrayView path) -> std::optional<QString>
+    {
+        c_json_cursor cursor(json);
+
+        while (!path.isEmpty())
+        {
+            const auto dot = path.indexOf('.');
+            const auto step = dot < 0 ? path : path.first(dot);
+            path = dot < 0 ? QByteArrayView() : path.sliced(dot + 1);
+
+            bool is_index = false;
+            const auto index = step.toLongLong(&is_index);
+            if (is_index ? !cursor.enter_element(index) : !cursor.enter_member(step))
+            {
+                return std::nullopt;
+            }
+        }
+
+        auto escaped = cursor.read_string();
+        if (!escaped)
+        {
+            return std::nullopt;
+        }
+        return decode_json_string(*escaped);
+    }
+
+    auto decode_json_string(QByteArrayView escaped) -> std::optional<QString>
+    {
+        // Most answers carry no escapes at all and decode in one pass
+        if (!escaped.contains('\\'))
+        {
+            return QString::fromUtf8(escaped);
+        }
+
+        QString text;
+        text.reserve(escaped.size());
+
+        qsizetype start = 0;
+        qsizetype pos = 0;
+        while (pos < escaped.size())
+        {
+            if (escaped[pos] != '\\')
+            {
+                ++pos;
+                continue;
+            }
+
+            text.append(QString::fromUtf8(escaped.sliced(start, pos - start)));
+            if (pos + 1 >= escaped.size())
+            {
+                return std::nullopt;
+            }
+
+            const char kind = escaped[pos + 1];
+            pos += 2;
+            switch (kind)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                text.append(QLatin1Char(kind));
+                break;
+            case 'b':
+                text.append(QLatin1Char('\b'));
+                break;
+            case 'f':
+                text.append(QLatin1Char('\f'));
+                break;
+            case 'n':
+                text.append(QLatin1Char('\n'));
+                break;
+            case 'r':
+                text.append(QLatin1Char('\r'));
+                break;
+            case 't':
+                text.append(QLatin1Char('\t'));
+                break;
+            case 'u':
+            {
+                // Surrogate pairs arrive as two escapes and are appended unit by unit
+                auto unit = hex_value(escaped.sliced(pos, std::min<qsizetype>(4, escaped.size() - pos)));
+                if (!unit)
+                {
+                    return std::nullopt;
+                }
+                text.append(QChar(*unit));
+                pos += 4;
+                break;
+            }
+            default:
+                return std::nullopt;
+            }
+            start = pos;
+        }
+
+        text.append(QString::fromUtf8(escaped.sliced(start)));
+        return text;
+    }
+
+    void append_json_escaped(QByteArray &out, QStringView text)
+    {
+        constexpr char hex_digits[] = "0123456789abcdef";
+
+        const auto utf8 = text.toUtf8();
+        out.reserve(out.size() + utf8.size() + 8);
+        for (const char c : utf8)
+        {
+            switch (c)
+            {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\b':
+                out.append("\\b");
+                break;
+            case '\f':
+                out.append("\\f");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    out.append("\\u00");
+                    out.append(hex_digits[(c >> 4) & 0xf]);
+                    out.append(hex_digits[c & 0xf]);
+                }
+                else
+                {
+                    out.append(c);
+                }
+            }
+        }
+    }
+
+} // namespace llm
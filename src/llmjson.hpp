@@ -0,0 +1,35 @@
+#ifndef LLMJSON_HPP
+#define LLMJSON_HPP
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QStringView>
+
+#include <optional>
+
+namespace llm
+{
+
+    // Pulls one string out of a JSON document without building a DOM. `path`
+    // is a dot-separated list of member names and array indices, e.g.
+    // "choices.0.message.content". Everything off the path is skipped byte by
+    // byte and only the target string is decoded, so verbose metadata around
+    // the answer costs next to nothing.
+    //
+    // Scanning stops at the target: a document that is malformed after it is
+    // not detected. nullopt means the path is absent, not a string, or the
+    // document is malformed before it; callers fall back to QJsonDocument
+    // when they need to know which.
+    [[nodiscard]] auto extract_json_string(QByteArrayView json, QByteArrayView path) -> std::optional<QString>;
+
+    // Decodes the body of a JSON string literal (without the quotes)
+    [[nodiscard]] auto decode_json_string(QByteArrayView escaped) -> std::optional<QString>;
+
+    // Appends `text` as the body of a JSON string literal (without the quotes),
+    // escaped the way QJsonDocument escapes it
+    void append_json_escaped(QByteArray &out, QStringView text);
+
+} // namespace llm
+
+#endif // LLMJSON_HPP
@@ -0,0 +1,46 @@
+#include "llmlatency.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace llm
+{
+
+    c_latency_window::c_latency_window(std::size_t capacity)
+        : m_capacity(std::max<std::size_t>(capacity, 1))
+    {
+        m_samples.reserve(m_capacity);
+    }
+
+    void c_latency_window::add(std::chrono::milliseconds sample)
+    {
+        if (m_samples.size() < m_capacity)
+        {
+            m_samples.push_back(sample);
+            return;
+        }
+
+        m_samples[m_next] = sample;
+        m_next = (m_next + 1) % m_capacity;
+    }
+
+    auto c_latency_window::size() const -> std::size_t
+    {
+        return m_samples.size();
+    }
+
+    auto c_latency_window::percentile(double quantile) const -> std::chrono::milliseconds
+    {
+        if (m_samples.empty())
+        {
+            return std::chrono::milliseconds(0);
+        }
+
+        auto sorted = m_samples;
+        const auto rank = static_cast<std::size_t>(std::ceil(std::clamp(quantile, 0.0, 1.0) * static_cast<double>(sorted.size())));
+        const auto index = std::clamp<std::size_t>(rank, 1, sorted.size()) - 1;
+        std::ranges::nth_element(sorted, sorted.begin() + static_cast<std::ptrdiff_t>(index));
+        return sorted[index];
+    }
+
+} // namespace llm
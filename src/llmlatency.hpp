@@ -0,0 +1,30 @@
+#ifndef LLMLATENCY_HPP
+#define LLMLATENCY_HPP
+
+#include <chrono>
+#include <vector>
+
+namespace llm
+{
+
+    // Fixed-size window over the most recent latency samples
+    class c_latency_window
+    {
+    public:
+        explicit c_latency_window(std::size_t capacity = 128);
+
+        void add(std::chrono::milliseconds sample);
+        [[nodiscard]] auto size() const -> std::size_t;
+
+        // `quantile` in [0, 1]; zero when no samples were recorded
+        [[nodiscard]] auto percentile(double quantile) const -> std::chrono::milliseconds;
+
+    private:
+        std::vector<std::chrono::milliseconds> m_samples;
+        std::size_t m_capacity;
+        std::size_t m_next{ 0 };
+    };
+
+} // namespace llm
+
+#endif // LLMLATENCY_HPP
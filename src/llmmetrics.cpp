@@ -0,0 +1,226 @@
+#include "llmmetrics.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+Q_LOGGING_CATEGORY(LLM_LATENCY, "org.kde.krunner.llm.latency", QtInfoMsg)
+
+namespace llm
+{
+
+    namespace
+    {
+        constexpr std::array reported_quantiles{ 0.5, 0.9, 0.99 };
+
+        auto to_ms(std::chrono::microseconds value) -> double
+        {
+            return static_cast<double>(value.count()) / 1000.0;
+        }
+    } // namespace
+
+    auto phase_name(e_phase phase) -> QLatin1StringView
+    {
+        switch (phase)
+        {
+        case e_phase::debounce:
+            return QLatin1StringView("debounce");
+        case e_phase::build:
+            return QLatin1StringView("build");
+        case e_phase::queue:
+            return QLatin1StringView("queue");
+        case e_phase::connect:
+            return QLatin1StringView("connect");
+        case e_phase::first_byte:
+            return QLatin1StringView("first_byte");
+        case e_phase::transfer:
+            return QLatin1StringView("transfer");
+        case e_phase::parse:
+            return QLatin1StringView("parse");
+        case e_phase::deliver:
+            return QLatin1StringView("deliver");
+        case e_phase::total:
+            return QLatin1StringView("total");
+        }
+        return {};
+    }
+
+    auto c_latency_histogram::bucket_index(std::uint64_t value) noexcept -> std::size_t
+    {
+        if (value < linear_limit)
+        {
+            return static_cast<std::size_t>(value);
+        }
+
+        // Shift so that the top bits fall into [sub_bucket_count, 2 * sub_bucket_count)
+        const auto shift = std::bit_width(value) - (sub_bucket_bits + 1);
+        if (shift > max_shift)
+        {
+            return bucket_count - 1;
+        }
+        const auto sub_bucket = (value >> shift) - sub_bucket_count;
+        return static_cast<std::size_t>(linear_limit + (shift - 1) * sub_bucket_count + sub_bucket);
+    }
+
+    auto c_latency_histogram::bucket_upper_bound(std::size_t index) noexcept -> std::uint64_t
+    {
+        if (index < linear_limit)
+        {
+            return index;
+        }
+
+        const auto offset = index - linear_limit;
+        const auto shift = static_cast<int>(offset / sub_bucket_count) + 1;
+        const auto sub_bucket = offset % sub_bucket_count + sub_bucket_count;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+    void c_latency_histogram::record(std::chrono::microseconds value) noexcept
+    {
+        const auto clamped = static_cast<std::uint64_t>(std::max<std::int64_t>(value.count(), 0));
+        m_counts[bucket_index(clamped)].fetch_add(1, std::memory_order_relaxed);
+        m_total.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void c_latency_histogram::reset() noexcept
+    {
+        for (auto &bucket : m_counts)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_total.store(0, std::memory_order_relaxed);
+    }
+
+    auto c_latency_histogram::count() const noexcept -> std::uint64_t
+    {
+        return m_total.load(std::memory_order_relaxed);
+    }
+
+    auto c_latency_histogram::percentile(double quantile) const noexcept -> std::chrono::microseconds
+    {
+        // Concurrent recording may move the total while we scan; the snapshot is approximate anyway
+        const auto total = count();
+        if (total == 0)
+        {
+            return std::chrono::microseconds(0);
+        }
+
+        const auto rank = std::max<std::uint64_t>(static_cast<std::uint64_t>(std::ceil(std::clamp(quantile, 0.0, 1.0) * static_cast<double>(total))), 1);
+        std::uint64_t seen = 0;
+        for (std::size_t index = 0; index < bucket_count; ++index)
+        {
+            seen += m_counts[index].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return std::chrono::microseconds(bucket_upper_bound(index));
+            }
+        }
+        return std::chrono::microseconds(bucket_upper_bound(bucket_count - 1));
+    }
+
+    void c_phase_metrics::record(e_phase phase, std::chrono::steady_clock::duration elapsed) noexcept
+    {
+        m_phases[static_cast<std::size_t>(phase)].record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
+    }
+
+    auto c_phase_metrics::histogram(e_phase phase) const noexcept -> const c_latency_histogram &
+    {
+        return m_phases[static_cast<std::size_t>(phase)];
+    }
+
+    auto c_latency_registry::instance() -> c_latency_registry &
+    {
+        static c_latency_registry registry;
+        return registry;
+    }
+
+    auto c_latency_registry::default_stats_path(const QString &name) -> QString
+    {
+        return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/krunner-llm/latency-%1.json").arg(name);
+    }
+
+    auto c_latency_registry::series(const QString &label) -> c_phase_metrics &
+    {
+        QMutexLocker lock(&m_mutex);
+        auto &entry = m_series[label];
+        if (!entry)
+        {
+            entry = std::make_unique<c_phase_metrics>();
+        }
+        return *entry;
+    }
+
+    auto c_latency_registry::report() const -> QString
+    {
+        QMutexLocker lock(&m_mutex);
+
+        QString text;
+        for (const auto &[label, metrics] : m_series)
+        {
+            for (std::size_t phase = 0; phase < phase_count; ++phase)
+            {
+                const auto &histogram = metrics->histogram(static_cast<e_phase>(phase));
+                if (histogram.count() == 0)
+                {
+                    continue;
+                }
+                text += QStringLiteral("%1 %2: n=%3 p50=%4ms p90=%5ms p99=%6ms\n")
+                            .arg(label, phase_name(static_cast<e_phase>(phase)))
+                            .arg(histogram.count())
+                            .arg(to_ms(histogram.percentile(0.5)), 0, 'f', 1)
+                            .arg(to_ms(histogram.percentile(0.9)), 0, 'f', 1)
+                            .arg(to_ms(histogram.percentile(0.99)), 0, 'f', 1);
+            }
+        }
+        return text;
+    }
+
+    auto c_latency_registry::to_json() const -> QJsonObject
+    {
+        QMutexLocker lock(&m_mutex);
+
+        QJsonObject json;
+        for (const auto &[label, metrics] : m_series)
+        {
+            QJsonObject phases;
+            for (std::size_t phase = 0; phase < phase_count; ++phase)
+            {
+                const auto &histogram = metrics->histogram(static_cast<e_phase>(phase));
+                if (histogram.count() == 0)
+                {
+                    continue;
+                }
+
+                QJsonObject stats;
+                stats[QStringLiteral("count")] = static_cast<qint64>(histogram.count());
+                for (const auto quantile : reported_quantiles)
+                {
+                    stats[QStringLiteral("p%1_ms").arg(std::lround(quantile * 100))] = to_ms(histogram.percentile(quantile));
+                }
+                phases[phase_name(static_cast<e_phase>(phase))] = stats;
+            }
+            json[label] = phases;
+        }
+        return json;
+    }
+
+    auto c_latency_registry::write_stats(const QString &path) const -> bool
+    {
+        QDir().mkpath(QFileInfo(path).absolutePath());
+
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            return false;
+        }
+        file.write(QJsonDocument(to_json()).toJson());
+        return file.commit();
+    }
+
+} // namespace llm
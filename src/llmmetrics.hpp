@@ -0,0 +1,103 @@
+#ifndef LLMMETRICS_HPP
+#define LLMMETRICS_HPP
+
+#include <QJsonObject>
+#include <QLatin1StringView>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QString>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+Q_DECLARE_LOGGING_CATEGORY(LLM_LATENCY)
+
+namespace llm
+{
+
+    // Stages of one query, from the keystroke to the answer on screen
+    enum class e_phase : std::uint8_t
+    {
+        debounce,   // last keystroke until the query is dispatched
+        build,      // build_request and build_payload
+        queue,      // waiting for a free connection
+        connect,    // DNS, TCP and TLS of a fresh connection (Qt does not split them)
+        first_byte, // request sent until the response headers arrive
+        transfer,   // response headers until the last body byte
+        parse,      // parse_response or the tail of the stream
+        deliver,    // adding the answer match
+        total       // dispatch until the answer is delivered
+    };
+
+    constexpr std::size_t phase_count = static_cast<std::size_t>(e_phase::total) + 1;
+
+    [[nodiscard]] auto phase_name(e_phase phase) -> QLatin1StringView;
+
+    // Log-linear histogram in the spirit of HdrHistogram: 32 linear sub-buckets
+    // per power of two keep every value within ~3% of its true size from 1µs
+    // to hours. Recording is a single relaxed atomic increment.
+    class c_latency_histogram
+    {
+    public:
+        void record(std::chrono::microseconds value) noexcept;
+        void reset() noexcept;
+
+        [[nodiscard]] auto count() const noexcept -> std::uint64_t;
+        // `quantile` in [0, 1]; the upper bound of the bucket holding that rank, zero when empty
+        [[nodiscard]] auto percentile(double quantile) const noexcept -> std::chrono::microseconds;
+
+        [[nodiscard]] static auto bucket_index(std::uint64_t value) noexcept -> std::size_t;
+        [[nodiscard]] static auto bucket_upper_bound(std::size_t index) noexcept -> std::uint64_t;
+
+    private:
+        static constexpr int sub_bucket_bits = 5;
+        static constexpr std::uint64_t sub_bucket_count = 1U << sub_bucket_bits;
+        // Values below this are counted exactly
+        static constexpr std::uint64_t linear_limit = 2 * sub_bucket_count;
+        static constexpr int max_shift = 32;
+        static constexpr std::size_t bucket_count = linear_limit + max_shift * sub_bucket_count;
+
+        std::array<std::atomic<std::uint64_t>, bucket_count> m_counts{};
+        std::atomic<std::uint64_t> m_total{ 0 };
+    };
+
+    // All phase histograms of one provider/model pair
+    class c_phase_metrics
+    {
+    public:
+        void record(e_phase phase, std::chrono::steady_clock::duration elapsed) noexcept;
+        [[nodiscard]] auto histogram(e_phase phase) const noexcept -> const c_latency_histogram &;
+
+    private:
+        std::array<c_latency_histogram, phase_count> m_phases;
+    };
+
+    // Process-wide home of the per-provider series. Series are never removed,
+    // so references handed out stay valid and recording needs no lock.
+    class c_latency_registry
+    {
+    public:
+        [[nodiscard]] static auto instance() -> c_latency_registry &;
+        // One file per front end, e.g. "runner" or "daemon", so they do not overwrite each other
+        [[nodiscard]] static auto default_stats_path(const QString &name) -> QString;
+
+        // `label` is usually "<provider>/<model>"
+        [[nodiscard]] auto series(const QString &label) -> c_phase_metrics &;
+
+        // p50/p90/p99 of every recorded phase, one line per series and phase
+        [[nodiscard]] auto report() const -> QString;
+        [[nodiscard]] auto to_json() const -> QJsonObject;
+        auto write_stats(const QString &path) const -> bool;
+
+    private:
+        mutable QMutex m_mutex;
+        std::map<QString, std::unique_ptr<c_phase_metrics>> m_series;
+    };
+
+} // namespace llm
+
+#endif // LLMMETRICS_HPP
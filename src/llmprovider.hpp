@@ -0,0 +1,218 @@
+#ifndef LLMPROVIDER_HPP
+#define LLMPROVIDER_HPP
+
+#include <QByteArrayView>
+#include <QLatin1StringView>
+
+#include <array>
+#include <cstdint>
+
+namespace llm
+{
+
+    enum class e_provider : std::uint8_t
+    {
+        OpenAI,
+        Anthropic,
+        OpenRouter,
+        Gemini,
+        Groq,
+        // llama.cpp, Ollama, vLLM or any other server speaking the OpenAI API
+        Local
+    };
+
+    // Shape of the request body
+    enum class e_payload_layout : std::uint8_t
+    {
+        // {"model", "messages": [{"role", "content"}], "max_tokens"}
+        chat_messages,
+        // {"contents": [{"parts": [{"text"}]}], "generationConfig": {"maxOutputTokens"}}
+        gemini_contents
+    };
+
+    // Everything that distinguishes one provider's API from another
+    struct s_provider_traits
+    {
+        // Name used in krunnerllmrc and in metric labels
+        QLatin1StringView name;
+        // %1 is replaced by the model
+        QLatin1StringView endpoint;
+        QLatin1StringView stream_endpoint;
+        QByteArrayView auth_header;
+        // Prepended to the API key in auth_header
+        QByteArrayView auth_prefix;
+        // Optional fixed header, e.g. the API version
+        QByteArrayView version_header;
+        QByteArrayView version;
+        e_payload_layout layout;
+        // Streaming is requested with "stream": true rather than through the endpoint
+        bool stream_flag;
+        // Earlier turns are only cached when marked with cache_control; other
+        // providers cache repeated prefixes on their own
+        bool cache_breakpoints;
+        // Where the answer text sits, see extract_json_string
+        QByteArrayView text_path;
+        QByteArrayView stream_text_path;
+    };
+
+    // One specialization per provider; adding a provider means adding one here
+    template <e_provider provider>
+    struct s_traits_of;
+
+    template <>
+    struct s_traits_of<e_provider::OpenAI>
+    {
+        static constexpr s_provider_traits value{
+            .name = QLatin1StringView("OpenAI"),
+            .endpoint = QLatin1StringView("https://api.openai.com/v1/chat/completions"),
+            .stream_endpoint = QLatin1StringView("https://api.openai.com/v1/chat/completions"),
+            .auth_header = "Authorization",
+            .auth_prefix = "Bearer ",
+            .version_header = {},
+            .version = {},
+            .layout = e_payload_layout::chat_messages,
+            .stream_flag = true,
+            .cache_breakpoints = false,
+            .text_path = "choices.0.message.content",
+            .stream_text_path = "choices.0.delta.content",
+        };
+    };
+
+    template <>
+    struct s_traits_of<e_provider::Anthropic>
+    {
+        static constexpr s_provider_traits value{
+            .name = QLatin1StringView("Anthropic"),
+            .endpoint = QLatin1StringView("https://api.anthropic.com/v1/messages"),
+            .stream_endpoint = QLatin1StringView("https://api.anthropic.com/v1/messages"),
+            .auth_header = "x-api-key",
+            .auth_prefix = {},
+            .version_header = "anthropic-version",
+            .version = "2023-06-01",
+            .layout = e_payload_layout::chat_messages,
+            .stream_flag = true,
+            .cache_breakpoints = true,
+            .text_path = "content.0.text",
+            // Only content_block_delta events carry delta.text
+            .stream_text_path = "delta.text",
+        };
+    };
+
+    template <>
+    struct s_traits_of<e_provider::OpenRouter>
+    {
+        static constexpr s_provider_traits value{
+            .name = QLatin1StringView("OpenRouter"),
+            .endpoint = QLatin1StringView("https://openrouter.ai/api/v1/chat/completions"),
+            .stream_endpoint = QLatin1StringView("https://openrouter.ai/api/v1/chat/completions"),
+            .auth_header = "Authorization",
+            .auth_prefix = "Bearer ",
+            .version_header = {},
+            .version = {},
+            .layout = e_payload_layout::chat_messages,
+            .stream_flag = true,
+            .cache_breakpoints = false,
+            .text_path = "choices.0.message.content",
+            .stream_text_path = "choices.0.delta.content",
+        };
+    };
+
+    template <>
+    struct s_traits_of<e_provider::Gemini>
+    {
+        // Gemini selects streaming through the method name rather than the payload
+        static constexpr s_provider_traits value{
+            .name = QLatin1StringView("Gemini"),
+            .endpoint = QLatin1StringView("https://generativelanguage.googleapis.com/v1beta/models/%1:generateContent"),
+            .stream_endpoint = QLatin1StringView("https://generativelanguage.googleapis.com/v1beta/models/%1:streamGenerateContent?alt=sse"),
+            .auth_header = "x-goog-api-key",
+            .auth_prefix = {},
+            .version_header = {},
+            .version = {},
+            .layout = e_payload_layout::gemini_contents,
+            .stream_flag = false,
+            .cache_breakpoints = false,
+            .text_path = "candidates.0.content.parts.0.text",
+            .stream_text_path = "candidates.0.content.parts.0.text",
+        };
+    };
+
+    template <>
+    struct s_traits_of<e_provider::Groq>
+    {
+        static constexpr s_provider_traits value{
+            .name = QLatin1StringView("Groq"),
+            .endpoint = QLatin1StringView("https://api.groq.com/openai/v1/chat/completions"),
+            .stream_endpoint = QLatin1StringView("https://api.groq.com/openai/v1/chat/completions"),
+            .auth_header = "Authorization",
+            .auth_prefix = "Bearer ",
+            .version_header = {},
+            .version = {},
+            .layout = e_payload_layout::chat_messages,
+            .stream_flag = true,
+            .cache_breakpoints = false,
+            .text_path = "choices.0.message.content",
+            .stream_text_path = "choices.0.delta.content",
+        };
+    };
+
+    template <>
+    struct s_traits_of<e_provider::Local>
+    {
+        // llama.cpp's default port; s_config::base_url points elsewhere, e.g. Ollama on :11434.
+        // The key is optional and only sent when configured.
+        static constexpr s_provider_traits value{
+            .name = QLatin1StringView("Local"),
+            .endpoint = QLatin1StringView("http://localhost:8080/v1/chat/completions"),
+            .stream_endpoint = QLatin1StringView("http://localhost:8080/v1/chat/completions"),
+            .auth_header = "Authorization",
+            .auth_prefix = "Bearer ",
+            .version_header = {},
+            .version = {},
+            .layout = e_payload_layout::chat_messages,
+            .stream_flag = true,
+            .cache_breakpoints = false,
+            .text_path = "choices.0.message.content",
+            .stream_text_path = "choices.0.delta.content",
+        };
+    };
+
+    // Every provider, in e_provider order
+    constexpr std::array all_providers{
+        e_provider::OpenAI,
+        e_provider::Anthropic,
+        e_provider::OpenRouter,
+        e_provider::Gemini,
+        e_provider::Groq,
+        e_provider::Local,
+    };
+
+    [[nodiscard]] constexpr auto provider_traits(e_provider provider) -> const s_provider_traits &
+    {
+        switch (provider)
+        {
+        case e_provider::OpenAI:
+            return s_traits_of<e_provider::OpenAI>::value;
+        case e_provider::Anthropic:
+            return s_traits_of<e_provider::Anthropic>::value;
+        case e_provider::OpenRouter:
+            return s_traits_of<e_provider::OpenRouter>::value;
+        case e_provider::Gemini:
+            return s_traits_of<e_provider::Gemini>::value;
+        case e_provider::Groq:
+            return s_traits_of<e_provider::Groq>::value;
+        case e_provider::Local:
+            return s_traits_of<e_provider::Local>::value;
+        }
+        return s_traits_of<e_provider::OpenAI>::value;
+    }
+
+    // The name used in krunnerllmrc and in metric labels
+    [[nodiscard]] constexpr auto provider_name(e_provider provider) -> QLatin1StringView
+    {
+        return provider_traits(provider).name;
+    }
+
+} // namespace llm
+
+#endif // LLMPROVIDER_HPP
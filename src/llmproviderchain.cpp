@@ -0,0 +1,156 @@
+#include "llmproviderchain.hpp"
+#include "llmsettings.hpp"
+
+#include <algorithm>
+
+namespace llm
+{
+
+    c_provider_chain::c_provider_chain(t_pool_source pool_source)
+        : m_pool_source(std::move(pool_source))
+    {
+    }
+
+    auto c_provider_chain::apply(const std::vector<s_config> &configs, int failure_threshold, std::chrono::milliseconds cooldown, std::optional<s_hedge_config> hedge,
+                                 const std::array<std::optional<s_config>, tier_count> &profiles) -> std::vector<bool>
+    {
+        std::vector<s_slot> slots;
+        slots.reserve(configs.size() + profiles.size());
+        for (const auto &config : configs)
+        {
+            slots.push_back(s_slot{ .config = config, .client = nullptr, .breaker = c_circuit_breaker(failure_threshold, cooldown) });
+        }
+        m_failover_count = configs.size();
+        for (std::size_t tier = 0; tier < profiles.size(); ++tier)
+        {
+            m_profiles[tier].reset();
+            if (profiles[tier])
+            {
+                m_profiles[tier] = slots.size();
+                slots.push_back(s_slot{ .config = *profiles[tier], .client = nullptr, .breaker = c_circuit_breaker(failure_threshold, cooldown) });
+            }
+        }
+
+        std::vector<bool> kept(m_slots.size(), false);
+        for (std::size_t index = 0; index < slots.size() && index < m_slots.size(); ++index)
+        {
+            auto &previous = m_slots[index];
+            if (!previous.client || !previous.client->reconfigure(slots[index].config))
+            {
+                continue;
+            }
+            kept[index] = true;
+            slots[index].client = std::move(previous.client);
+            slots[index].breaker = previous.breaker;
+            slots[index].breaker.set_limits(failure_threshold, cooldown);
+        }
+
+        // A new primary client picks up m_hedge when client() creates it
+        const bool hedge_changed = hedge != m_hedge;
+        m_slots = std::move(slots);
+        m_hedge = std::move(hedge);
+        if (hedge_changed && !m_slots.empty() && m_slots.front().client)
+        {
+            m_slots.front().client->set_hedging(m_hedge);
+        }
+        return kept;
+    }
+
+    auto c_provider_chain::client(std::size_t index) -> c_client &
+    {
+        // One client per provider serves every query so its replies outlive the caller
+        auto &slot = m_slots[index];
+        if (!slot.client)
+        {
+            slot.client = std::make_unique<c_client>(slot.config, m_pool_source());
+            if (index == 0)
+            {
+                slot.client->set_hedging(m_hedge);
+            }
+        }
+        return *slot.client;
+    }
+
+    auto c_provider_chain::breaker(std::size_t index) -> c_circuit_breaker &
+    {
+        return m_slots[index].breaker;
+    }
+
+    auto c_provider_chain::config(std::size_t index) const -> const s_config &
+    {
+        return m_slots[index].config;
+    }
+
+    auto c_provider_chain::probing(std::size_t index) const -> bool
+    {
+        // A half-open breaker lets exactly one request through, so the one just admitted is it
+        return index < m_slots.size() && m_slots[index].breaker.state() == e_breaker_state::half_open;
+    }
+
+    void c_provider_chain::release_probe(std::size_t index)
+    {
+        if (index < m_slots.size())
+        {
+            m_slots[index].breaker.release_probe();
+        }
+    }
+
+    auto c_provider_chain::available(std::size_t index, bool offline) -> bool
+    {
+        // Checked first so a skipped remote provider keeps its half-open probe
+        if (offline && needs_network(m_slots[index].config))
+        {
+            return false;
+        }
+        return m_slots[index].breaker.allow_request();
+    }
+
+    auto c_provider_chain::next_available(std::size_t first, bool offline) -> std::optional<std::size_t>
+    {
+        for (auto index = first; index < m_failover_count; ++index)
+        {
+            if (available(index, offline))
+            {
+                return index;
+            }
+        }
+        return std::nullopt;
+    }
+
+    auto c_provider_chain::next_fallback(std::size_t failed, bool offline) -> std::optional<std::size_t>
+    {
+        return next_available(failed < m_failover_count ? failed + 1 : 0, offline);
+    }
+
+    auto c_provider_chain::profile(e_tier tier, bool offline) -> std::optional<std::size_t>
+    {
+        const auto index = m_profiles[static_cast<std::size_t>(tier)];
+        if (!index || !available(*index, offline))
+        {
+            return std::nullopt;
+        }
+        return index;
+    }
+
+    auto c_provider_chain::routed(e_tier tier) const -> std::size_t
+    {
+        return m_profiles[static_cast<std::size_t>(tier)].value_or(0);
+    }
+
+    auto c_provider_chain::routed_config(e_tier tier) const -> const s_config &
+    {
+        return m_slots[routed(tier)].config;
+    }
+
+    auto c_provider_chain::serves_offline() const -> bool
+    {
+        return std::any_of(m_slots.begin(), m_slots.begin() + static_cast<std::ptrdiff_t>(m_failover_count), [](const s_slot &slot)
+                           { return !needs_network(slot.config); });
+    }
+
+    auto c_provider_chain::size() const -> std::size_t
+    {
+        return m_slots.size();
+    }
+
+} // namespace llm
@@ -0,0 +1,79 @@
+#ifndef LLMPROVIDERCHAIN_HPP
+#define LLMPROVIDERCHAIN_HPP
+
+#include "llmclient.hpp"
+#include "llmconnectionpool.hpp"
+#include "llmhealth.hpp"
+#include "llmrouter.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace llm
+{
+
+    // The configured provider followed by its fallbacks, then the routing
+    // profiles. Every slot creates its client on first use and keeps a circuit
+    // breaker, so a provider that keeps failing is skipped without touching
+    // the network.
+    class c_provider_chain
+    {
+    public:
+        // Called when the first client is created, so the pool lives in the thread using it
+        using t_pool_source = std::function<std::shared_ptr<c_connection_pool>()>;
+
+        explicit c_provider_chain(t_pool_source pool_source);
+
+        // Swaps in a new list. A slot whose provider, key, model and server are
+        // unchanged keeps its client, warm connections and breaker, and has its
+        // limits updated in place. Returns which of the previous slots did so.
+        auto apply(const std::vector<s_config> &configs, int failure_threshold, std::chrono::milliseconds cooldown, std::optional<s_hedge_config> hedge,
+                   const std::array<std::optional<s_config>, tier_count> &profiles = {}) -> std::vector<bool>;
+
+        // The first slot also hedges, when hedging is configured
+        [[nodiscard]] auto client(std::size_t index = 0) -> c_client &;
+        [[nodiscard]] auto breaker(std::size_t index) -> c_circuit_breaker &;
+        [[nodiscard]] auto config(std::size_t index) const -> const s_config &;
+        // Whether the request the slot just let through is its breaker's half-open probe
+        [[nodiscard]] auto probing(std::size_t index) const -> bool;
+        // Frees the slot's half-open probe after its request was cancelled; ignores indices past the list
+        void release_probe(std::size_t index);
+        // First failover slot from `first` on whose breaker lets a request through.
+        // Offline, only servers on this machine are considered.
+        [[nodiscard]] auto next_available(std::size_t first = 0, bool offline = false) -> std::optional<std::size_t>;
+        // The slot a question of the tier is meant for: its profile, otherwise the configured provider
+        [[nodiscard]] auto routed(e_tier tier) const -> std::size_t;
+        [[nodiscard]] auto routed_config(e_tier tier) const -> const s_config &;
+        // Where to go after slot `failed`; a routing profile falls back to the configured provider
+        [[nodiscard]] auto next_fallback(std::size_t failed, bool offline = false) -> std::optional<std::size_t>;
+        // The slot of the tier's routing profile, if it has one that can take a request
+        [[nodiscard]] auto profile(e_tier tier, bool offline = false) -> std::optional<std::size_t>;
+        // Whether a failover slot can answer without a network; creates no clients
+        [[nodiscard]] auto serves_offline() const -> bool;
+        // All slots, profiles included; an index past them means no provider
+        [[nodiscard]] auto size() const -> std::size_t;
+
+    private:
+        [[nodiscard]] auto available(std::size_t index, bool offline) -> bool;
+
+        struct s_slot
+        {
+            s_config config;
+            std::unique_ptr<c_client> client;
+            c_circuit_breaker breaker;
+        };
+
+        t_pool_source m_pool_source;
+        std::vector<s_slot> m_slots;
+        // Slots before this one form the failover list
+        std::size_t m_failover_count{ 0 };
+        std::array<std::optional<std::size_t>, tier_count> m_profiles;
+        std::optional<s_hedge_config> m_hedge;
+    };
+
+} // namespace llm
+
+#endif // LLMPROVIDERCHAIN_HPP
@@ -0,0 +1,235 @@
+#include "llmratelimit.hpp"
+
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace llm
+{
+
+    namespace
+    {
+        constexpr double ms_per_minute = 60.0 * 1000.0;
+
+        auto make_bucket_rate(int per_minute) -> double
+        {
+            return per_minute > 0 ? per_minute / ms_per_minute : 0.0;
+        }
+
+        auto find_header(const t_raw_headers &headers, QByteArrayView name) -> std::optional<QByteArray>
+        {
+            for (const auto &[header_name, value] : headers)
+            {
+                if (header_name.compare(name, Qt::CaseInsensitive) == 0)
+                {
+                    return value.trimmed();
+                }
+            }
+            return std::nullopt;
+        }
+
+        auto until(const QDateTime &when, const QDateTime &now) -> std::optional<std::chrono::milliseconds>
+        {
+            if (!when.isValid())
+            {
+                return std::nullopt;
+            }
+            return std::chrono::milliseconds(std::max<qint64>(now.msecsTo(when), 0));
+        }
+    } // namespace
+
+    auto c_rate_limiter::s_bucket::take(double cost, double elapsed_ms) -> double
+    {
+        if (rate_per_ms <= 0.0)
+        {
+            return 0.0;
+        }
+
+        level = std::min(capacity, level + elapsed_ms * rate_per_ms);
+        // A single request larger than the whole bucket would otherwise wait forever
+        level -= std::min(cost, capacity);
+        return level >= 0.0 ? 0.0 : -level / rate_per_ms;
+    }
+
+    void c_rate_limiter::s_bucket::set_limit(int per_minute)
+    {
+        const auto was_limited = rate_per_ms > 0.0;
+        rate_per_ms = make_bucket_rate(per_minute);
+        capacity = std::max(per_minute, 0);
+        // A newly limited bucket starts full: a minute's worth of burst is what the provider allows too
+        level = was_limited ? std::min(level, capacity) : capacity;
+    }
+
+    c_rate_limiter::c_rate_limiter(int requests_per_minute, int tokens_per_minute)
+        : m_last_refill(t_clock::now())
+    {
+        set_limits(requests_per_minute, tokens_per_minute);
+    }
+
+    auto c_rate_limiter::shared(const QString &account) -> std::shared_ptr<c_rate_limiter>
+    {
+        // Clients may live in different threads (runner, daemon), hence the lock
+        static QMutex registry_mutex;
+        static QHash<QString, std::weak_ptr<c_rate_limiter>> registry;
+
+        QMutexLocker lock(&registry_mutex);
+        if (auto existing = registry.value(account).lock())
+        {
+            return existing;
+        }
+
+        auto limiter = std::make_shared<c_rate_limiter>(0, 0);
+        registry.insert(account, limiter);
+        return limiter;
+    }
+
+    auto c_rate_limiter::reserve(int tokens, t_clock::time_point now) -> std::chrono::milliseconds
+    {
+        QMutexLocker lock(&m_mutex);
+
+        const auto elapsed_ms = std::chrono::duration<double, std::milli>(std::max(now - m_last_refill, t_clock::duration::zero())).count();
+        m_last_refill = std::max(now, m_last_refill);
+
+        const auto request_wait = m_requests.take(1.0, elapsed_ms);
+        const auto token_wait = m_tokens.take(static_cast<double>(tokens), elapsed_ms);
+        const auto blocked_wait = std::chrono::duration<double, std::milli>(std::max(m_blocked_until - now, t_clock::duration::zero())).count();
+
+        // Shave off rounding noise so an exact one-second wait is not reported as 1001ms
+        const auto wait_ms = std::max({ request_wait, token_wait, blocked_wait });
+        return std::chrono::milliseconds(static_cast<qint64>(std::ceil(wait_ms - 1e-6)));
+    }
+
+    void c_rate_limiter::block_until(t_clock::time_point until)
+    {
+        QMutexLocker lock(&m_mutex);
+        m_blocked_until = std::max(m_blocked_until, until);
+    }
+
+    void c_rate_limiter::set_limits(int requests_per_minute, int tokens_per_minute)
+    {
+        QMutexLocker lock(&m_mutex);
+        m_requests.set_limit(requests_per_minute);
+        m_tokens.set_limit(tokens_per_minute);
+    }
+
+    auto parse_rate_limit_headers(const t_raw_headers &headers, const QDateTime &now) -> s_rate_limit_hint
+    {
+        s_rate_limit_hint hint;
+
+        if (auto value = find_header(headers, "retry-after-ms"))
+        {
+            bool ok = false;
+            const auto milliseconds = value->toDouble(&ok);
+            if (ok)
+            {
+                hint.retry_after = std::chrono::milliseconds(static_cast<qint64>(std::ceil(milliseconds)));
+            }
+        }
+
+        if (auto value = find_header(headers, "retry-after"); value && !hint.retry_after)
+        {
+            bool ok = false;
+            const auto seconds = value->toDouble(&ok);
+            if (ok)
+            {
+                hint.retry_after = std::chrono::milliseconds(static_cast<qint64>(std::ceil(seconds * 1000.0)));
+            }
+            else
+            {
+                hint.retry_after = until(QDateTime::fromString(QString::fromLatin1(*value), Qt::RFC2822Date), now);
+            }
+        }
+
+        // Only an exhausted quota forces a wait; the reset time is either a
+        // duration (OpenAI, Groq) or a timestamp (Anthropic).
+        struct s_quota_headers
+        {
+            QByteArrayView remaining;
+            QByteArrayView reset;
+        };
+        constexpr std::array quotas{
+            s_quota_headers{ "x-ratelimit-remaining-requests", "x-ratelimit-reset-requests" },
+            s_quota_headers{ "x-ratelimit-remaining-tokens", "x-ratelimit-reset-tokens" },
+            s_quota_headers{ "anthropic-ratelimit-requests-remaining", "anthropic-ratelimit-requests-reset" },
+            s_quota_headers{ "anthropic-ratelimit-tokens-remaining", "anthropic-ratelimit-tokens-reset" },
+        };
+
+        for (const auto &quota : quotas)
+        {
+            auto remaining = find_header(headers, quota.remaining);
+            auto reset = find_header(headers, quota.reset);
+            if (!remaining || !reset || remaining->toLongLong() > 0)
+            {
+                continue;
+            }
+
+            auto wait = parse_duration(*reset);
+            if (!wait)
+            {
+                wait = until(QDateTime::fromString(QString::fromLatin1(*reset), Qt::ISODateWithMs), now);
+            }
+            if (wait && (!hint.quota_reset || *wait > *hint.quota_reset))
+            {
+                hint.quota_reset = wait;
+            }
+        }
+
+        return hint;
+    }
+
+    auto parse_duration(QByteArrayView text) -> std::optional<std::chrono::milliseconds>
+    {
+        static const QRegularExpression component(QStringLiteral("(\\d+(?:\\.\\d+)?)(ms|h|m|s)"));
+        static const QRegularExpression whole(QStringLiteral("^(?:\\d+(?:\\.\\d+)?(?:ms|h|m|s))+$"));
+
+        const auto input = QString::fromLatin1(text);
+        if (!whole.match(input).hasMatch())
+        {
+            return std::nullopt;
+        }
+
+        double total_ms = 0.0;
+        auto matches = component.globalMatch(input);
+        while (matches.hasNext())
+        {
+            const auto match = matches.next();
+            const auto value = match.captured(1).toDouble();
+            const auto unit = match.captured(2);
+            if (unit == QStringLiteral("ms"))
+            {
+                total_ms += value;
+            }
+            else if (unit == QStringLiteral("s"))
+            {
+                total_ms += value * 1000.0;
+            }
+            else if (unit == QStringLiteral("m"))
+            {
+                total_ms += value * 60.0 * 1000.0;
+            }
+            else
+            {
+                total_ms += value * 60.0 * 60.0 * 1000.0;
+            }
+        }
+
+        return std::chrono::milliseconds(static_cast<qint64>(std::ceil(total_ms)));
+    }
+
+    auto backoff_delay(int attempt) -> std::chrono::milliseconds
+    {
+        constexpr qint64 base_ms = 250;
+        constexpr qint64 max_ms = 8000;
+
+        // Equal jitter: half the exponential step is fixed, half is random,
+        // so concurrent clients spread out without ever retrying instantly.
+        const auto step = std::min(base_ms << std::clamp(attempt, 0, 5), max_ms);
+        const auto jitter = static_cast<qint64>(QRandomGenerator::global()->bounded(static_cast<quint32>(step / 2 + 1)));
+        return std::chrono::milliseconds(step / 2 + jitter);
+    }
+
+} // namespace llm
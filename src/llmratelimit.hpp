@@ -0,0 +1,83 @@
+#ifndef LLMRATELIMIT_HPP
+#define LLMRATELIMIT_HPP
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+
+namespace llm
+{
+
+    // Client-side token buckets for one provider account: one for requests per
+    // minute and one for tokens per minute. Reservations that exceed the budget
+    // are not rejected but delayed, which smooths bursts locally instead of
+    // having the provider answer them with 429s. A limit of 0 means unlimited.
+    class c_rate_limiter
+    {
+    public:
+        using t_clock = std::chrono::steady_clock;
+
+        c_rate_limiter(int requests_per_minute, int tokens_per_minute);
+
+        // Process-wide limiter shared by every client using the same account
+        [[nodiscard]] static auto shared(const QString &account) -> std::shared_ptr<c_rate_limiter>;
+
+        // Takes capacity for one request and returns how long to wait before sending it
+        [[nodiscard]] auto reserve(int tokens, t_clock::time_point now = t_clock::now()) -> std::chrono::milliseconds;
+
+        // Holds back every request until `until`, e.g. after a 429 with Retry-After
+        void block_until(t_clock::time_point until);
+        // Keeps what has already been spent, so re-applying the settings grants no fresh burst
+        void set_limits(int requests_per_minute, int tokens_per_minute);
+
+    private:
+        struct s_bucket
+        {
+            double rate_per_ms{ 0.0 };
+            double capacity{ 0.0 };
+            double level{ 0.0 };
+
+            // Returns the wait in milliseconds until `cost` is covered
+            [[nodiscard]] auto take(double cost, double elapsed_ms) -> double;
+            void set_limit(int per_minute);
+        };
+
+        mutable QMutex m_mutex;
+        s_bucket m_requests;
+        s_bucket m_tokens;
+        t_clock::time_point m_last_refill;
+        t_clock::time_point m_blocked_until;
+    };
+
+    using t_raw_headers = QList<QPair<QByteArray, QByteArray>>;
+
+    struct s_rate_limit_hint
+    {
+        // Explicit server request to wait (Retry-After, retry-after-ms)
+        std::optional<std::chrono::milliseconds> retry_after;
+        // Time until an exhausted request or token quota resets (x-ratelimit-*)
+        std::optional<std::chrono::milliseconds> quota_reset;
+    };
+
+    // Understands Retry-After (seconds or HTTP date), retry-after-ms and the
+    // OpenAI/Groq x-ratelimit-* and Anthropic anthropic-ratelimit-* headers
+    [[nodiscard]] auto parse_rate_limit_headers(const t_raw_headers &headers, const QDateTime &now = QDateTime::currentDateTimeUtc()) -> s_rate_limit_hint;
+
+    // Parses Go-style durations such as "20ms", "1.5s" or "6m0s"
+    [[nodiscard]] auto parse_duration(QByteArrayView text) -> std::optional<std::chrono::milliseconds>;
+
+    // Exponential backoff with jitter for retry `attempt` (0-based), capped at 8s
+    [[nodiscard]] auto backoff_delay(int attempt) -> std::chrono::milliseconds;
+
+} // namespace llm
+
+#endif // LLMRATELIMIT_HPP
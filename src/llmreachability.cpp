@@ -0,0 +1,39 @@
+#include "llmreachability.hpp"
+
+namespace llm
+{
+
+    c_reachability::c_reachability(QObject *context, t_callback on_change)
+        : m_on_change(std::move(on_change))
+    {
+        // Loading is shared by everyone in the process and cheap to repeat
+        if (!QNetworkInformation::loadBackendByFeatures(QNetworkInformation::Feature::Reachability))
+        {
+            return;
+        }
+
+        auto *information = QNetworkInformation::instance();
+        m_online = is_online(information->reachability());
+        QObject::connect(information, &QNetworkInformation::reachabilityChanged, context, [this](QNetworkInformation::Reachability reachability)
+                         {
+                         const bool online = is_online(reachability);
+                         if (online == m_online)
+                         {
+                             return;
+                         }
+                         m_online = online;
+                         m_on_change(online); });
+    }
+
+    auto c_reachability::is_online() const -> bool
+    {
+        return m_online;
+    }
+
+    auto c_reachability::is_online(QNetworkInformation::Reachability reachability) -> bool
+    {
+        // A site network without internet may still reach a server configured by base_url
+        return reachability != QNetworkInformation::Reachability::Disconnected && reachability != QNetworkInformation::Reachability::Local;
+    }
+
+} // namespace llm
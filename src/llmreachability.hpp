@@ -0,0 +1,37 @@
+#ifndef LLMREACHABILITY_HPP
+#define LLMREACHABILITY_HPP
+
+#include <QNetworkInformation>
+#include <QObject>
+
+#include <functional>
+
+namespace llm
+{
+
+    // Whether the machine is online, as reported by QNetworkInformation. Only
+    // link-local or no connectivity counts as offline; platforms without a
+    // reachability backend are always considered online.
+    class c_reachability
+    {
+    public:
+        using t_callback = std::function<void(bool online)>;
+
+        // `on_change` runs in `context`'s thread when the machine goes on- or offline
+        c_reachability(QObject *context, t_callback on_change);
+
+        c_reachability(const c_reachability &) = delete;
+        auto operator=(const c_reachability &) -> c_reachability & = delete;
+
+        [[nodiscard]] auto is_online() const -> bool;
+
+        [[nodiscard]] static auto is_online(QNetworkInformation::Reachability reachability) -> bool;
+
+    private:
+        t_callback m_on_change;
+        bool m_online{ true };
+    };
+
+} // namespace llm
+
+#endif // LLMREACHABILITY_HPP
@@ -0,0 +1,149 @@
+#include "llmrouter.hpp"
+
+#include <QRegularExpressionMatchIterator>
+
+// The per-question debug lines are off unless asked for
+Q_LOGGING_CATEGORY(LLM_ROUTING, "org.kde.krunner.llm.routing", QtInfoMsg)
+
+namespace llm
+{
+
+    namespace
+    {
+        // At most this many words with nothing else to go by is a lookup
+        constexpr int short_prompt_words = 6;
+        // At least this many words is a task rather than a question
+        constexpr int long_prompt_words = 40;
+
+        auto rule(const QString &pattern) -> QRegularExpression
+        {
+            return QRegularExpression(pattern, QRegularExpression::CaseInsensitiveOption | QRegularExpression::UseUnicodePropertiesOption);
+        }
+
+        auto code_block() -> const QRegularExpression &
+        {
+            // Backticks or a brace block are code on their own
+            static const QRegularExpression pattern(QStringLiteral(R"(`|\{[^}]*\})"));
+            return pattern;
+        }
+
+        auto code_hint() -> const QRegularExpression &
+        {
+            // Scope and arrow operators, comparisons, includes, calls and statement ends
+            static const QRegularExpression pattern(QStringLiteral(R"(::|->|=>|==|#include|\w\([^)]*\)|;)"));
+            return pattern;
+        }
+
+        // One hint alone is too weak: "f(x)" or "A -> B" turn up in plain questions
+        auto looks_like_code(const QString &prompt) -> bool
+        {
+            if (code_block().match(prompt).hasMatch())
+            {
+                return true;
+            }
+            int hints = 0;
+            auto it = code_hint().globalMatch(prompt);
+            while (hints < 2 && it.hasNext())
+            {
+                static_cast<void>(it.next());
+                ++hints;
+            }
+            return hints >= 2;
+        }
+
+        auto strong_keywords() -> const QRegularExpression &
+        {
+            // Only verbs of multi-step tasks; a topic such as "python" says nothing about the effort
+            static const QRegularExpression pattern = rule(QStringLiteral(
+                R"(\b(explain why|step by step|prove|derive|analy[sz]e|debug|refactor|optimi[sz]e|implement)\b)"));
+            return pattern;
+        }
+
+        auto balanced_keywords() -> const QRegularExpression &
+        {
+            static const QRegularExpression pattern = rule(QStringLiteral(R"(\b(explain|summari[sz]e|write|why|how (do|does|can|to))\b)"));
+            return pattern;
+        }
+    } // namespace
+
+    auto tier_name(e_tier tier) -> QLatin1StringView
+    {
+        switch (tier)
+        {
+        case e_tier::fast:
+            return QLatin1StringView("fast");
+        case e_tier::balanced:
+            return QLatin1StringView("balanced");
+        case e_tier::strong:
+            return QLatin1StringView("strong");
+        }
+        return QLatin1StringView("balanced");
+    }
+
+    void c_router::set_rules(const QString &fast_pattern, const QString &strong_pattern)
+    {
+        m_fast_rule = fast_pattern.isEmpty() ? QRegularExpression() : rule(fast_pattern);
+        m_strong_rule = strong_pattern.isEmpty() ? QRegularExpression() : rule(strong_pattern);
+        for (auto *expression : { &m_fast_rule, &m_strong_rule })
+        {
+            if (!expression->isValid())
+            {
+                qCWarning(LLM_ROUTING) << "Ignoring routing pattern" << expression->pattern() << expression->errorString();
+                *expression = QRegularExpression();
+            }
+        }
+    }
+
+    auto c_router::classify(const QString &prompt) const -> s_route
+    {
+        const auto words = static_cast<int>(prompt.split(QLatin1Char(' '), Qt::SkipEmptyParts).size());
+        const auto route = [words](e_tier tier, const char *reason)
+        {
+            return s_route{ .tier = tier, .reason = QLatin1StringView(reason), .words = words };
+        };
+
+        // The user's rules win over the built-in heuristics
+        if (!m_strong_rule.pattern().isEmpty() && m_strong_rule.match(prompt).hasMatch())
+        {
+            return route(e_tier::strong, "rule");
+        }
+        if (!m_fast_rule.pattern().isEmpty() && m_fast_rule.match(prompt).hasMatch())
+        {
+            return route(e_tier::fast, "rule");
+        }
+
+        if (looks_like_code(prompt))
+        {
+            return route(e_tier::strong, "code");
+        }
+        if (strong_keywords().match(prompt).hasMatch())
+        {
+            return route(e_tier::strong, "keyword");
+        }
+        if (words >= long_prompt_words)
+        {
+            return route(e_tier::strong, "length");
+        }
+        if (balanced_keywords().match(prompt).hasMatch())
+        {
+            return route(e_tier::balanced, "keyword");
+        }
+        if (words <= short_prompt_words)
+        {
+            return route(e_tier::fast, "length");
+        }
+        return route(e_tier::balanced, "default");
+    }
+
+    void c_router::log(const s_route &route, const s_config &served_by, std::chrono::milliseconds latency, bool succeeded)
+    {
+        // The prompt itself is not logged, only what the rules saw of it
+        qCDebug(LLM_ROUTING).noquote() << QStringLiteral("tier=%1 reason=%2 words=%3 provider=%4 model=%5 latency=%6ms result=%7")
+                                              .arg(tier_name(route.tier), route.reason)
+                                              .arg(route.words)
+                                              .arg(provider_name(served_by.provider), served_by.model)
+                                              .arg(latency.count())
+                                              .arg(succeeded ? QLatin1StringView("ok") : QLatin1StringView("error"));
+    }
+
+} // namespace llm
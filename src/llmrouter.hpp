@@ -0,0 +1,74 @@
+#ifndef LLMROUTER_HPP
+#define LLMROUTER_HPP
+
+#include "llmclient.hpp"
+
+#include <QLatin1StringView>
+#include <QLoggingCategory>
+#include <QRegularExpression>
+#include <QString>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+Q_DECLARE_LOGGING_CATEGORY(LLM_ROUTING)
+
+namespace llm
+{
+
+    // Latency tiers a question can be routed to, cheapest first
+    enum class e_tier : std::uint8_t
+    {
+        fast,
+        balanced,
+        strong
+    };
+
+    constexpr std::size_t tier_count = 3;
+
+    [[nodiscard]] auto tier_name(e_tier tier) -> QLatin1StringView;
+
+    // The [Routing] group of krunnerllmrc
+    struct s_routing
+    {
+        // Indexed by e_tier; a tier without a profile is answered by the configured provider
+        std::array<std::optional<s_config>, tier_count> profiles;
+        // Case-insensitive regular expressions checked before the heuristics
+        QString fast_pattern;
+        QString strong_pattern;
+    };
+
+    // Where a question goes and which rule sent it there
+    struct s_route
+    {
+        e_tier tier{ e_tier::balanced };
+        QLatin1StringView reason;
+        int words{ 0 };
+    };
+
+    // Classifies questions locally, in microseconds, by the user's rules, code
+    // fragments, keywords and length: "capital of peru" needs no strong model,
+    // "refactor this function" does.
+    class c_router
+    {
+    public:
+        c_router() = default;
+
+        // Invalid patterns are reported and ignored
+        void set_rules(const QString &fast_pattern, const QString &strong_pattern);
+
+        [[nodiscard]] auto classify(const QString &prompt) const -> s_route;
+
+        // Logs the route of an answered question to LLM_ROUTING, with its latency, so the rules can be tuned
+        static void log(const s_route &route, const s_config &served_by, std::chrono::milliseconds latency, bool succeeded);
+
+    private:
+        QRegularExpression m_fast_rule;
+        QRegularExpression m_strong_rule;
+    };
+
+} // namespace llm
+
+#endif // LLMROUTER_HPP
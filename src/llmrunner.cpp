@@ -1,5 +1,4 @@
 #include "llmrunner.hpp"
-#include "llmclient.hpp"
 #include <KConfigGroup>
 #include <KLocalizedString>
 #include <KSharedConfig>
@@ -11,74 +10,44 @@ K_PLUGIN_CLASS_WITH_JSON(c_llm_runner, "plasma-runner-llm.json")
 c_llm_runner::c_llm_runner(QObject *parent, const KPluginMetaData &metaData)
     : AbstractRunner(parent, metaData)
 {
-    load_config();
-    const auto trigger_len = m_trigger_word.length() + 2;
-    setMinLetterCount(trigger_len);
-
     // Setup debounce timer to avoid multiple concurrent requests
     m_debounce_timer = new QTimer(this);
     m_debounce_timer->setSingleShot(true);
-    m_debounce_timer->setInterval(m_debounce_delay);
     connect(m_debounce_timer, &QTimer::timeout, this, [this]()
             {
         if (!m_pending_prompt.isEmpty()) {
+            m_engine.record_debounce(m_pending_prompt, std::chrono::steady_clock::now() - m_debounce_armed);
             perform_query(m_pending_prompt, m_pending_context);
         } });
+
+    load_config();
+
+    // The KCM saves with KConfig::Notify; caches and untouched clients survive a reload
+    m_config_watcher = KConfigWatcher::create(KSharedConfig::openConfig(QStringLiteral("krunnerllmrc")));
+    connect(m_config_watcher.data(), &KConfigWatcher::configChanged, this, [this]()
+            { load_config(); });
 }
 
 void c_llm_runner::load_config()
 {
-    auto config = KSharedConfig::openConfig(QStringLiteral("krunnerllmrc"));
-    auto group = config->group(QStringLiteral("General"));
-
-    m_trigger_word = group.readEntry(QStringLiteral("TriggerWord"), QStringLiteral("llm"));
-
-    auto api_key = group.readEntry(QStringLiteral("ApiKey"), QString());
-    auto provider = group.readEntry(QStringLiteral("Provider"), QStringLiteral("OpenAI"));
-    auto model = group.readEntry(QStringLiteral("Model"), QStringLiteral("gpt-4"));
-    auto max_tokens = group.readEntry(QStringLiteral("MaxTokens"), 150);
-    auto timeout = group.readEntry(QStringLiteral("Timeout"), 30000);
-    auto debounce_delay = group.readEntry(QStringLiteral("DebounceDelay"), 800);
-
-    m_configured = !api_key.isEmpty();
-
-    if (provider == QStringLiteral("OpenAI"))
-    {
-        m_config.provider = llm::e_provider::OpenAI;
-    }
-    else if (provider == QStringLiteral("Anthropic"))
-    {
-        m_config.provider = llm::e_provider::Anthropic;
-    }
-    else if (provider == QStringLiteral("OpenRouter"))
-    {
-        m_config.provider = llm::e_provider::OpenRouter;
-    }
-    else if (provider == QStringLiteral("Gemini"))
-    {
-        m_config.provider = llm::e_provider::Gemini;
-    }
-    else if (provider == QStringLiteral("Groq"))
-    {
-        m_config.provider = llm::e_provider::Groq;
-    }
+    const auto settings = llm::read_settings(KSharedConfig::openConfig(QStringLiteral("krunnerllmrc")));
 
-    m_config.apiKey = api_key;
-    m_config.model = model;
-    m_config.max_tokens = max_tokens;
-    m_config.timeout_ms = timeout;
-    m_debounce_delay = debounce_delay;
-
-    // Update timer interval if timer already exists
-    if (m_debounce_timer)
-    {
-        m_debounce_timer->setInterval(m_debounce_delay);
-    }
+    m_trigger_word = settings.trigger_word;
+    m_engine.apply(settings);
+    setMinLetterCount(m_trigger_word.length() + 2);
 }
 
-auto c_llm_runner::create_client() const -> std::unique_ptr<llm ::c_client>
+void c_llm_runner::answer_offline(const QString &prompt, KRunner::RunnerContext &context)
 {
-    return std::make_unique<llm::c_client>(m_config);
+    m_engine.queue_offline(prompt, { waiter(context) });
+
+    KRunner::QueryMatch offline_match(this);
+    offline_match.setCategoryRelevance(KRunner::QueryMatch::CategoryRelevance::Moderate);
+    offline_match.setIconName(QStringLiteral("network-offline"));
+    offline_match.setText(i18n("You are offline"));
+    offline_match.setSubtext(m_engine.replays_offline() ? i18n("The question will be asked once the network is back") : i18n("Connect to a network to ask the LLM"));
+    offline_match.setRelevance(0.9);
+    context.addMatch(offline_match);
 }
 
 void c_llm_runner::match(KRunner::RunnerContext &context)
@@ -96,7 +65,7 @@ void c_llm_runner::match(KRunner::RunnerContext &context)
         return;
     }
 
-    if (!m_configured)
+    if (!m_engine.configured())
     {
         KRunner::QueryMatch match(this);
         match.setCategoryRelevance(KRunner::QueryMatch::CategoryRelevance::Moderate);
@@ -115,6 +84,10 @@ void c_llm_runner::match(KRunner::RunnerContext &context)
         // Stop any pending query
         m_debounce_timer->stop();
         m_pending_prompt.clear();
+        m_engine.cancel_superseded(QString());
+
+        // A question is about to be typed: get DNS, TCP and TLS out of the way now
+        m_engine.prewarm();
 
         KRunner::QueryMatch match(this);
         match.setCategoryRelevance(KRunner::QueryMatch::CategoryRelevance::Moderate);
@@ -126,11 +99,46 @@ void c_llm_runner::match(KRunner::RunnerContext &context)
         return;
     }
 
+    m_engine.record_keystroke(prompt);
+
+    // Whatever is in flight for an older prompt is stale from this keystroke on,
+    // speculative requests included
+    const auto key = m_engine.cache_key(prompt);
+    m_engine.cancel_superseded(key);
+
+    // Answer repeated prompts without arming the debounce timer at all
+    if (auto cached = m_engine.cached_response(key))
+    {
+        m_debounce_timer->stop();
+        m_pending_prompt.clear();
+        add_response_match(*cached, context);
+        return;
+    }
+
+    // Nothing could reach a provider: say so now rather than after DNS, TCP or a timeout
+    if (m_engine.unreachable())
+    {
+        m_debounce_timer->stop();
+        m_pending_prompt.clear();
+        answer_offline(prompt, context);
+        return;
+    }
+
+    // A finished-looking question goes out without waiting for the debounce
+    if (m_engine.speculate(prompt))
+    {
+        m_debounce_timer->stop();
+        m_pending_prompt.clear();
+        perform_query(prompt, context);
+        return;
+    }
+
     // Cancel any pending request and schedule a new one
     m_debounce_timer->stop();
     m_pending_prompt = prompt;
     m_pending_context = context;
-    m_debounce_timer->start();
+    m_debounce_armed = std::chrono::steady_clock::now();
+    m_debounce_timer->start(m_engine.debounce_delay());
 
     // Show a "typing" indicator while waiting
     KRunner::QueryMatch typing_match(this);
@@ -149,6 +157,13 @@ void c_llm_runner::perform_query(const QString &prompt, KRunner::RunnerContext &
         return;
     }
 
+    // The network may have gone while the debounce ran
+    if (m_engine.unreachable())
+    {
+        answer_offline(prompt, context);
+        return;
+    }
+
     // Show a "querying" match
     KRunner::QueryMatch querying_match(this);
     querying_match.setCategoryRelevance(KRunner::QueryMatch::CategoryRelevance::Moderate);
@@ -158,23 +173,59 @@ void c_llm_runner::perform_query(const QString &prompt, KRunner::RunnerContext &
     querying_match.setRelevance(0.9);
     context.addMatch(querying_match);
 
-    // Perform the actual query
-    auto client = create_client();
-    auto result = client->send_message(prompt);
+    m_engine.cancel_superseded(m_engine.cache_key(prompt));
+    m_engine.ask(prompt, waiter(context));
+}
 
-    if (!result.has_value())
-    {
-        handle_error(result.error(), context);
-        return;
-    }
+auto c_llm_runner::waiter(const KRunner::RunnerContext &context) -> llm::c_query_engine::s_waiter
+{
+    return {
+        .answer = [this, context](const QString &answer, e_answer kind) mutable
+        {
+            if (!context.isValid())
+            {
+                return false;
+            }
+            add_response_match(answer, context, kind);
+            return true;
+        },
+        .fail = [this, context](const llm::s_error &error) mutable
+        {
+            if (!context.isValid())
+            {
+                return false;
+            }
+            handle_error(error, context);
+            return true;
+        },
+    };
+}
 
-    const auto &response = result.value();
+auto c_llm_runner::stats() const -> const s_stats &
+{
+    return m_engine.stats();
+}
 
+void c_llm_runner::add_response_match(const QString &response, KRunner::RunnerContext &context, e_answer answer)
+{
     KRunner::QueryMatch match(this);
+    // A stable id lets each update replace the previous partial answer
+    match.setId(QStringLiteral("answer"));
     match.setCategoryRelevance(KRunner::QueryMatch::CategoryRelevance::Highest);
     match.setIconName(QStringLiteral("dialog-information"));
     match.setText(response);
-    match.setSubtext(i18n("Click to copy response"));
+    switch (answer)
+    {
+    case e_answer::complete:
+        match.setSubtext(i18n("Click to copy response"));
+        break;
+    case e_answer::partial:
+        match.setSubtext(i18n("Receiving response..."));
+        break;
+    case e_answer::draft:
+        match.setSubtext(i18n("Quick draft, a better answer is on its way"));
+        break;
+    }
     match.setRelevance(1.0);
     match.setData(response);
     match.setMultiLine(true);
@@ -189,49 +240,27 @@ void c_llm_runner::perform_query(const QString &prompt, KRunner::RunnerContext &
 void c_llm_runner::run(const KRunner::RunnerContext &context,
                        const KRunner::QueryMatch &match)
 {
-    Q_UNUSED(context);
-
     auto response = match.data().toString();
     if (!response.isEmpty())
     {
         auto *clipboard = QGuiApplication::clipboard();
         clipboard->setText(response);
+
+        // The session, the settings and the requests belong to the match
+        // thread, so continue there
+        QMetaObject::invokeMethod(this, [this, query = context.query(), response]()
+                                  { m_engine.take_answer(query.mid(m_trigger_word.length() + 1).trimmed(), response); });
     }
 }
 
 void c_llm_runner::handle_error(const llm::s_error &error, KRunner::RunnerContext &context)
 {
-    QString error_text;
-    QString error_subtext;
-
-    switch (error.code)
-    {
-    case llm::e_error_code::network_error:
-        error_text = i18n("Network Error");
-        error_subtext = error.message;
-        break;
-    case llm::e_error_code::invalid_api_key:
-        error_text = i18n("API Key Error");
-        error_subtext = i18n("Invalid or missing API key");
-        break;
-    case llm::e_error_code::invalid_response:
-        error_text = i18n("Invalid Response");
-        error_subtext = error.message;
-        break;
-    case llm::e_error_code::timeout:
-        error_text = i18n("Request Timeout");
-        error_subtext = i18n("The request took too long");
-        break;
-    case llm::e_error_code::rate_limited:
-        error_text = i18n("Rate Limited");
-        error_subtext = i18n("Too many requests, try again later");
-        break;
-    }
+    const auto description = llm::describe(error);
 
     KRunner::QueryMatch error_match(this);
     error_match.setIconName(QStringLiteral("dialog-error"));
-    error_match.setText(error_text);
-    error_match.setSubtext(error_subtext);
+    error_match.setText(description.text);
+    error_match.setSubtext(description.subtext);
     error_match.setRelevance(0.8);
     error_match.setCategoryRelevance(KRunner::QueryMatch::CategoryRelevance::High);
     context.addMatch(error_match);
@@ -1,38 +1,49 @@
 #ifndef LLMRUNNER_HPP
 #define LLMRUNNER_HPP
 
-#include "llmclient.hpp"
+#include "llmengine.hpp"
+#include "llmsettings.hpp"
+#include <KConfigWatcher>
 #include <KRunner/AbstractRunner>
 #include <KRunner/Action>
 #include <KRunner/QueryMatch>
 #include <QTimer>
-#include <memory>
 
 class c_llm_runner : public KRunner::AbstractRunner
 {
     Q_OBJECT
 
 public:
+    using s_stats = llm::c_query_engine::s_stats;
+
     c_llm_runner(QObject *parent, const KPluginMetaData &metaData);
-    ~c_llm_runner() override = default;
 
     void match(KRunner::RunnerContext &context) override;
     void run(const KRunner::RunnerContext &context,
              const KRunner::QueryMatch &match) override;
 
+    [[nodiscard]] auto stats() const -> const s_stats &;
+
 private:
+    using e_answer = llm::c_query_engine::e_answer;
+
     void load_config();
-    [[nodiscard]] auto create_client() const -> std::unique_ptr<llm::c_client>;
+    // Shows the offline notice and keeps the question for later when replay is on
+    void answer_offline(const QString &prompt, KRunner::RunnerContext &context);
     void handle_error(const llm ::s_error &error, KRunner::RunnerContext &context);
     void perform_query(const QString &prompt, KRunner::RunnerContext &context);
+    // Delivers answers to `context` for as long as KRunner still shows it
+    [[nodiscard]] auto waiter(const KRunner::RunnerContext &context) -> llm::c_query_engine::s_waiter;
+    void add_response_match(const QString &response, KRunner::RunnerContext &context, e_answer answer = e_answer::complete);
 
     QString m_trigger_word;
-    llm::s_config m_config;
-    bool m_configured{ false };
-    int m_debounce_delay{ 800 };
     QTimer *m_debounce_timer{ nullptr };
+    std::chrono::steady_clock::time_point m_debounce_armed;
     QString m_pending_prompt;
     KRunner::RunnerContext m_pending_context;
+    llm::c_query_engine m_engine{ this, QStringLiteral("runner"), true };
+    // Applies settings saved in the KCM without restarting KRunner
+    KConfigWatcher::Ptr m_config_watcher;
 };
 
 #endif // LLMRUNNER_HPP
@@ -0,0 +1,66 @@
+#include "llmsession.hpp"
+
+#include <algorithm>
+
+namespace llm
+{
+
+    c_session::c_session(int max_turns, std::chrono::milliseconds idle_timeout)
+        : m_max_turns(max_turns), m_idle_timeout(idle_timeout)
+    {
+    }
+
+    auto c_session::history(t_clock::time_point now) -> const QList<s_message> &
+    {
+        if (!m_messages.isEmpty() && now - m_last_used >= m_idle_timeout)
+        {
+            m_messages.clear();
+        }
+        return m_messages;
+    }
+
+    void c_session::add_turn(const QString &prompt, const QString &answer, t_clock::time_point now)
+    {
+        if (m_max_turns <= 0 || prompt.isEmpty() || answer.isEmpty())
+        {
+            return;
+        }
+
+        // Expire first so a stale conversation is not continued by the new turn
+        static_cast<void>(history(now));
+        if (turns() >= m_max_turns)
+        {
+            const auto dropped = std::max(1, m_max_turns / 2);
+            m_messages.remove(0, qsizetype(dropped) * 2);
+        }
+
+        m_messages.append(s_message{ .role = QStringLiteral("user"), .content = prompt });
+        m_messages.append(s_message{ .role = QStringLiteral("assistant"), .content = answer });
+        m_last_used = now;
+    }
+
+    void c_session::clear()
+    {
+        m_messages.clear();
+    }
+
+    void c_session::set_limits(int max_turns, std::chrono::milliseconds idle_timeout)
+    {
+        m_max_turns = max_turns;
+        m_idle_timeout = idle_timeout;
+        if (m_max_turns <= 0)
+        {
+            m_messages.clear();
+        }
+        while (turns() > std::max(0, m_max_turns))
+        {
+            m_messages.remove(0, 2);
+        }
+    }
+
+    auto c_session::turns() const -> int
+    {
+        return static_cast<int>(m_messages.size() / 2);
+    }
+
+} // namespace llm
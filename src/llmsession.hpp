@@ -0,0 +1,43 @@
+#ifndef LLMSESSION_HPP
+#define LLMSESSION_HPP
+
+#include "llmclient.hpp"
+
+#include <QList>
+#include <QString>
+
+#include <chrono>
+
+namespace llm
+{
+
+    // The recent exchanges a follow-up question is asked against. Bounded in
+    // turns and forgotten after an idle timeout. When full, the older half is
+    // dropped at once, so the prefix the provider has cached stays valid for
+    // several follow-ups instead of shifting on every one of them.
+    class c_session
+    {
+    public:
+        using t_clock = std::chrono::steady_clock;
+
+        c_session(int max_turns, std::chrono::milliseconds idle_timeout);
+
+        // Alternating user/assistant messages, oldest first; empty once idle too long
+        [[nodiscard]] auto history(t_clock::time_point now = t_clock::now()) -> const QList<s_message> &;
+        void add_turn(const QString &prompt, const QString &answer, t_clock::time_point now = t_clock::now());
+        void clear();
+
+        // Zero turns disables sessions
+        void set_limits(int max_turns, std::chrono::milliseconds idle_timeout);
+        [[nodiscard]] auto turns() const -> int;
+
+    private:
+        int m_max_turns;
+        std::chrono::milliseconds m_idle_timeout;
+        QList<s_message> m_messages;
+        t_clock::time_point m_last_used;
+    };
+
+} // namespace llm
+
+#endif // LLMSESSION_HPP
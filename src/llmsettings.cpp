@@ -0,0 +1,277 @@
+#include "llmsettings.hpp"
+
+#include <KConfigGroup>
+#include <QUrl>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace llm
+{
+
+    namespace
+    {
+        // Clients on one provider account share a rate limiter, so they must agree on its
+        // limits: a slot that leaves them unset takes the first limits configured for the account
+        void share_account_limits(s_settings &settings)
+        {
+            std::vector<s_config *> configs{ &settings.primary };
+            for (auto &fallback : settings.fallbacks)
+            {
+                configs.push_back(&fallback);
+            }
+            if (settings.hedge)
+            {
+                configs.push_back(&settings.hedge->secondary);
+            }
+            for (auto &profile : settings.routing.profiles)
+            {
+                if (profile)
+                {
+                    configs.push_back(&*profile);
+                }
+            }
+            if (settings.draft)
+            {
+                configs.push_back(&*settings.draft);
+            }
+
+            const auto same_account = [](const s_config *lhs, const s_config *rhs)
+            {
+                return lhs->provider == rhs->provider && lhs->apiKey == rhs->apiKey;
+            };
+            for (auto *config : configs)
+            {
+                for (const auto *other : configs)
+                {
+                    if (!same_account(config, other))
+                    {
+                        continue;
+                    }
+                    if (other->requests_per_minute > 0)
+                    {
+                        config->requests_per_minute = other->requests_per_minute;
+                        break;
+                    }
+                }
+                for (const auto *other : configs)
+                {
+                    if (!same_account(config, other))
+                    {
+                        continue;
+                    }
+                    if (other->tokens_per_minute > 0)
+                    {
+                        config->tokens_per_minute = other->tokens_per_minute;
+                        break;
+                    }
+                }
+            }
+        }
+    } // namespace
+
+    auto parse_provider(const QString &name, e_provider fallback) -> e_provider
+    {
+        for (const auto candidate : all_providers)
+        {
+            if (name == provider_name(candidate))
+            {
+                return candidate;
+            }
+        }
+        return fallback;
+    }
+
+    auto is_configured(const s_config &config) -> bool
+    {
+        return !config.apiKey.isEmpty() || config.provider == e_provider::Local;
+    }
+
+    auto needs_network(const s_config &config) -> bool
+    {
+        if (config.base_url.isEmpty())
+        {
+            return config.provider != e_provider::Local;
+        }
+
+        const QUrl url(config.base_url);
+        if (url.scheme() == QLatin1StringView("unix"))
+        {
+            return false;
+        }
+        const auto host = url.host();
+        return host != QLatin1StringView("localhost") && host != QLatin1StringView("127.0.0.1") && host != QLatin1StringView("::1");
+    }
+
+    auto read_settings(const KSharedConfig::Ptr &config) -> s_settings
+    {
+        s_settings settings;
+        auto group = config->group(QStringLiteral("General"));
+
+        settings.trigger_word = group.readEntry(QStringLiteral("TriggerWord"), QStringLiteral("llm"));
+
+        auto &primary = settings.primary;
+        primary.provider = parse_provider(group.readEntry(QStringLiteral("Provider"), QStringLiteral("OpenAI")), e_provider::OpenAI);
+        primary.apiKey = group.readEntry(QStringLiteral("ApiKey"), QString());
+        primary.model = group.readEntry(QStringLiteral("Model"), QStringLiteral("gpt-4"));
+        primary.max_tokens = group.readEntry(QStringLiteral("MaxTokens"), 150);
+        primary.timeout_ms = group.readEntry(QStringLiteral("Timeout"), 30000);
+        primary.connect_timeout_ms = group.readEntry(QStringLiteral("ConnectTimeout"), 1500);
+        primary.first_byte_timeout_ms = group.readEntry(QStringLiteral("FirstByteTimeout"), 15000);
+        primary.idle_timeout_ms = group.readEntry(QStringLiteral("IdleTimeout"), 10000);
+        primary.requests_per_minute = group.readEntry(QStringLiteral("RequestsPerMinute"), 0);
+        primary.tokens_per_minute = group.readEntry(QStringLiteral("TokensPerMinute"), 0);
+        primary.base_url = group.readEntry(QStringLiteral("BaseUrl"), QString());
+
+        settings.debounce_delay = std::chrono::milliseconds(group.readEntry(QStringLiteral("DebounceDelay"), 800));
+        settings.adaptive_debounce = group.readEntry(QStringLiteral("AdaptiveDebounce"), true);
+        settings.debounce_min = std::chrono::milliseconds(group.readEntry(QStringLiteral("DebounceMin"), 250));
+        settings.debounce_max = std::chrono::milliseconds(group.readEntry(QStringLiteral("DebounceMax"), 1500));
+        settings.speculative_per_minute = group.readEntry(QStringLiteral("SpeculativePerMinute"), 6);
+        settings.streaming = group.readEntry(QStringLiteral("Streaming"), true);
+        settings.cache_size = group.readEntry(QStringLiteral("CacheSize"), 64);
+        settings.cache_ttl = std::chrono::seconds(group.readEntry(QStringLiteral("CacheTtl"), 3600));
+        settings.keep_alive = std::chrono::seconds(group.readEntry(QStringLiteral("KeepAlive"), 120));
+        settings.prewarm_interval = std::chrono::seconds(group.readEntry(QStringLiteral("PrewarmInterval"), 30));
+        settings.disk_cache_bytes = qint64(group.readEntry(QStringLiteral("DiskCacheSize"), 8)) * 1024 * 1024;
+        settings.disk_cache_ttl = std::chrono::seconds(group.readEntry(QStringLiteral("DiskCacheTtl"), 7 * 24 * 3600));
+        settings.session_turns = group.readEntry(QStringLiteral("SessionTurns"), 4);
+        settings.session_timeout = std::chrono::seconds(group.readEntry(QStringLiteral("SessionTimeout"), 300));
+        settings.replay_offline = group.readEntry(QStringLiteral("ReplayOffline"), false);
+
+        // Ordered failover list: the configured provider first, then the [Failover][n] groups
+        auto failover = config->group(QStringLiteral("Failover"));
+        settings.failure_threshold = failover.readEntry(QStringLiteral("FailureThreshold"), 3);
+        settings.cooldown = std::chrono::seconds(failover.readEntry(QStringLiteral("Cooldown"), 30));
+
+        auto fallback_groups = failover.groupList();
+        std::ranges::sort(fallback_groups, [](const QString &lhs, const QString &rhs)
+                          { return lhs.toInt() < rhs.toInt(); });
+        for (const auto &name : std::as_const(fallback_groups))
+        {
+            auto fallback_group = failover.group(name);
+            s_config fallback = primary;
+            fallback.provider = parse_provider(fallback_group.readEntry(QStringLiteral("Provider"), QString()), primary.provider);
+            fallback.apiKey = fallback_group.readEntry(QStringLiteral("ApiKey"), QString());
+            fallback.model = fallback_group.readEntry(QStringLiteral("Model"), QString());
+            fallback.requests_per_minute = fallback_group.readEntry(QStringLiteral("RequestsPerMinute"), 0);
+            fallback.tokens_per_minute = fallback_group.readEntry(QStringLiteral("TokensPerMinute"), 0);
+            fallback.base_url = fallback_group.readEntry(QStringLiteral("BaseUrl"), QString());
+            if (!is_configured(fallback) || fallback.model.isEmpty())
+            {
+                continue;
+            }
+            settings.fallbacks.push_back(fallback);
+        }
+
+        // Optional duplicate of slow requests to a second provider
+        auto hedging = config->group(QStringLiteral("Hedging"));
+        if (hedging.readEntry(QStringLiteral("Enabled"), false))
+        {
+            s_hedge_config hedge;
+            hedge.secondary.provider = parse_provider(hedging.readEntry(QStringLiteral("Provider"), QStringLiteral("Groq")), e_provider::Groq);
+            hedge.secondary.apiKey = hedging.readEntry(QStringLiteral("ApiKey"), QString());
+            hedge.secondary.model = hedging.readEntry(QStringLiteral("Model"), QStringLiteral("llama-3.3-70b-versatile"));
+            hedge.secondary.max_tokens = primary.max_tokens;
+            hedge.secondary.timeout_ms = primary.timeout_ms;
+            hedge.secondary.connect_timeout_ms = primary.connect_timeout_ms;
+            hedge.secondary.first_byte_timeout_ms = primary.first_byte_timeout_ms;
+            hedge.secondary.idle_timeout_ms = primary.idle_timeout_ms;
+            hedge.percentile = hedging.readEntry(QStringLiteral("Percentile"), 95) / 100.0;
+            hedge.budget = hedging.readEntry(QStringLiteral("Budget"), 5) / 100.0;
+            hedge.initial_delay = std::chrono::milliseconds(hedging.readEntry(QStringLiteral("InitialDelay"), 2000));
+            if (!hedge.secondary.apiKey.isEmpty())
+            {
+                settings.hedge = hedge;
+            }
+        }
+
+        // Optional per-tier profiles questions are routed to by their class
+        auto routing = config->group(QStringLiteral("Routing"));
+        if (routing.readEntry(QStringLiteral("Enabled"), false))
+        {
+            settings.routing.fast_pattern = routing.readEntry(QStringLiteral("FastPattern"), QString());
+            settings.routing.strong_pattern = routing.readEntry(QStringLiteral("StrongPattern"), QString());
+            const std::array<std::pair<e_tier, QString>, tier_count> groups{ { { e_tier::fast, QStringLiteral("Fast") },
+                                                                                { e_tier::balanced, QStringLiteral("Balanced") },
+                                                                                { e_tier::strong, QStringLiteral("Strong") } } };
+            for (const auto &[tier, name] : groups)
+            {
+                if (!routing.hasGroup(name))
+                {
+                    continue;
+                }
+
+                // Unset keys are taken from the configured provider, as long as it is the same one
+                auto profile_group = routing.group(name);
+                s_config profile = primary;
+                profile.provider = parse_provider(profile_group.readEntry(QStringLiteral("Provider"), QString()), primary.provider);
+                const bool same_provider = profile.provider == primary.provider;
+                profile.apiKey = profile_group.readEntry(QStringLiteral("ApiKey"), same_provider ? primary.apiKey : QString());
+                profile.base_url = profile_group.readEntry(QStringLiteral("BaseUrl"), same_provider ? primary.base_url : QString());
+                profile.model = profile_group.readEntry(QStringLiteral("Model"), QString());
+                profile.max_tokens = profile_group.readEntry(QStringLiteral("MaxTokens"), primary.max_tokens);
+                if (!same_provider)
+                {
+                    profile.requests_per_minute = profile_group.readEntry(QStringLiteral("RequestsPerMinute"), 0);
+                    profile.tokens_per_minute = profile_group.readEntry(QStringLiteral("TokensPerMinute"), 0);
+                }
+                if (is_configured(profile) && !profile.model.isEmpty())
+                {
+                    settings.routing.profiles[static_cast<std::size_t>(tier)] = profile;
+                }
+            }
+        }
+
+        // Optional quick draft from a fast model, upgraded by the main answer
+        auto cascade = config->group(QStringLiteral("Cascade"));
+        if (cascade.readEntry(QStringLiteral("Enabled"), false))
+        {
+            s_config draft = primary;
+            draft.provider = parse_provider(cascade.readEntry(QStringLiteral("Provider"), QStringLiteral("Groq")), e_provider::Groq);
+            draft.apiKey = cascade.readEntry(QStringLiteral("ApiKey"), QString());
+            draft.model = cascade.readEntry(QStringLiteral("Model"), QStringLiteral("llama-3.1-8b-instant"));
+            draft.base_url = cascade.readEntry(QStringLiteral("BaseUrl"), QString());
+            draft.max_tokens = cascade.readEntry(QStringLiteral("MaxTokens"), primary.max_tokens);
+            draft.requests_per_minute = cascade.readEntry(QStringLiteral("RequestsPerMinute"), 0);
+            draft.tokens_per_minute = cascade.readEntry(QStringLiteral("TokensPerMinute"), 0);
+            if (is_configured(draft) && !draft.model.isEmpty())
+            {
+                settings.draft = draft;
+            }
+            settings.skip_upgrade_when_used = cascade.readEntry(QStringLiteral("SkipUpgradeWhenUsed"), true);
+        }
+
+        share_account_limits(settings);
+        return settings;
+    }
+
+    auto read_cadence_state() -> s_cadence_state
+    {
+        auto state = KSharedConfig::openStateConfig(QStringLiteral("krunnerllmstaterc"));
+        auto group = state->group(QStringLiteral("TypingCadence"));
+
+        s_cadence_state cadence;
+        cadence.mean_ms = group.readEntry(QStringLiteral("Mean"), 0.0);
+        cadence.variance_ms = group.readEntry(QStringLiteral("Variance"), 0.0);
+        cadence.samples = group.readEntry(QStringLiteral("Samples"), 0);
+        return cadence;
+    }
+
+    void write_cadence_state(const s_cadence_state &cadence)
+    {
+        if (cadence.samples == 0)
+        {
+            return;
+        }
+
+        auto state = KSharedConfig::openStateConfig(QStringLiteral("krunnerllmstaterc"));
+        auto group = state->group(QStringLiteral("TypingCadence"));
+        group.writeEntry(QStringLiteral("Mean"), cadence.mean_ms);
+        group.writeEntry(QStringLiteral("Variance"), cadence.variance_ms);
+        group.writeEntry(QStringLiteral("Samples"), cadence.samples);
+        state->sync();
+    }
+
+} // namespace llm
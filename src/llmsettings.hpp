@@ -0,0 +1,68 @@
+#ifndef LLMSETTINGS_HPP
+#define LLMSETTINGS_HPP
+
+#include "llmcadence.hpp"
+#include "llmclient.hpp"
+#include "llmrouter.hpp"
+
+#include <KSharedConfig>
+#include <QString>
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+namespace llm
+{
+
+    // Everything krunnerllmrc configures, read the same way by the runner
+    // plugin and the D-Bus daemon
+    struct s_settings
+    {
+        QString trigger_word{ QStringLiteral("llm") };
+        s_config primary;
+        // The [Failover][n] groups in order; the primary is always tried first
+        std::vector<s_config> fallbacks;
+        int failure_threshold{ 3 };
+        std::chrono::seconds cooldown{ 30 };
+        std::optional<s_hedge_config> hedge;
+        // Per-tier profiles; empty unless routing is enabled
+        s_routing routing;
+        // Fast model whose draft is shown until the main answer replaces it
+        std::optional<s_config> draft;
+        // Cancel the main request once the user has taken the draft
+        bool skip_upgrade_when_used{ true };
+        std::chrono::milliseconds debounce_delay{ 800 };
+        bool adaptive_debounce{ true };
+        std::chrono::milliseconds debounce_min{ 250 };
+        std::chrono::milliseconds debounce_max{ 1500 };
+        // Finished-looking questions sent before the debounce runs out, per minute; 0 disables
+        int speculative_per_minute{ 6 };
+        bool streaming{ true };
+        qsizetype cache_size{ 64 };
+        std::chrono::seconds cache_ttl{ 3600 };
+        std::chrono::seconds keep_alive{ 120 };
+        std::chrono::seconds prewarm_interval{ 30 };
+        qint64 disk_cache_bytes{ qint64(8) * 1024 * 1024 };
+        std::chrono::seconds disk_cache_ttl{ 7 * 24 * 3600 };
+        int session_turns{ 4 };
+        std::chrono::seconds session_timeout{ 300 };
+        // Ask the questions typed while offline once the network is back
+        bool replay_offline{ false };
+    };
+
+    [[nodiscard]] auto parse_provider(const QString &name, e_provider fallback) -> e_provider;
+    // Local servers usually run without a key; every other provider needs one
+    [[nodiscard]] auto is_configured(const s_config &config) -> bool;
+    // False for servers on this machine, which stay reachable without a network
+    [[nodiscard]] auto needs_network(const s_config &config) -> bool;
+    [[nodiscard]] auto read_settings(const KSharedConfig::Ptr &config) -> s_settings;
+
+    // Typing statistics are state, not configuration: they live in krunnerllmstaterc
+    [[nodiscard]] auto read_cadence_state() -> s_cadence_state;
+    // Does nothing before the first keystroke, keeping what was learned earlier
+    void write_cadence_state(const s_cadence_state &cadence);
+
+} // namespace llm
+
+#endif // LLMSETTINGS_HPP
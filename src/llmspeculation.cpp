@@ -0,0 +1,42 @@
+#include "llmspeculation.hpp"
+
+namespace llm
+{
+
+    c_speculation::c_speculation(int per_minute)
+        : m_per_minute(per_minute)
+    {
+    }
+
+    void c_speculation::set_limit(int per_minute)
+    {
+        m_per_minute = per_minute;
+    }
+
+    auto c_speculation::looks_complete(const QString &prompt) const -> bool
+    {
+        if (m_per_minute <= 0 || prompt.isEmpty())
+        {
+            return false;
+        }
+
+        // The full-width form is what CJK input methods produce
+        const auto last = prompt.back();
+        return last == QLatin1Char('?') || last == QChar(0xFF1F);
+    }
+
+    auto c_speculation::try_acquire(t_clock::time_point now) -> bool
+    {
+        while (!m_sent.isEmpty() && now - m_sent.first() >= std::chrono::minutes(1))
+        {
+            m_sent.removeFirst();
+        }
+        if (m_sent.size() >= m_per_minute)
+        {
+            return false;
+        }
+        m_sent.append(now);
+        return true;
+    }
+
+} // namespace llm
@@ -0,0 +1,38 @@
+#ifndef LLMSPECULATION_HPP
+#define LLMSPECULATION_HPP
+
+#include <QList>
+#include <QString>
+
+#include <chrono>
+
+namespace llm
+{
+
+    // Decides when a prompt reads as finished, so its request can go out
+    // before the debounce runs out. Speculating wastes the request whenever
+    // the user keeps typing, so only a few may be sent per minute.
+    class c_speculation
+    {
+    public:
+        using t_clock = std::chrono::steady_clock;
+
+        // Zero disables speculation
+        explicit c_speculation(int per_minute);
+
+        void set_limit(int per_minute);
+
+        // A trailing question mark; a question answered before comes from the cache anyway
+        [[nodiscard]] auto looks_complete(const QString &prompt) const -> bool;
+        // Spends one of this minute's speculative requests; false once they are used up
+        [[nodiscard]] auto try_acquire(t_clock::time_point now = t_clock::now()) -> bool;
+
+    private:
+        int m_per_minute;
+        // When the speculative requests of the last minute went out, oldest first
+        QList<t_clock::time_point> m_sent;
+    };
+
+} // namespace llm
+
+#endif // LLMSPECULATION_HPP
@@ -0,0 +1,89 @@
+#include "llmsse.hpp"
+
+namespace llm
+{
+
+    auto c_sse_parser::feed(QByteArrayView bytes) -> QList<s_sse_event>
+    {
+        QList<s_sse_event> events;
+        m_buffer.append(bytes);
+
+        qsizetype line_start = 0;
+        while (true)
+        {
+            const auto newline = m_buffer.indexOf('\n', line_start);
+            if (newline < 0)
+            {
+                break;
+            }
+
+            auto line = QByteArrayView(m_buffer).sliced(line_start, newline - line_start);
+            if (line.endsWith('\r'))
+            {
+                line.chop(1);
+            }
+            process_line(line, events);
+            line_start = newline + 1;
+        }
+
+        // Keep only the unterminated tail for the next read
+        m_buffer.remove(0, line_start);
+        return events;
+    }
+
+    void c_sse_parser::reset()
+    {
+        m_buffer.clear();
+        m_current = {};
+        m_has_data = false;
+    }
+
+    void c_sse_parser::process_line(QByteArrayView line, QList<s_sse_event> &events)
+    {
+        // A blank line dispatches the event collected so far
+        if (line.isEmpty())
+        {
+            if (m_has_data)
+            {
+                events.append(std::move(m_current));
+            }
+            m_current = {};
+            m_has_data = false;
+            return;
+        }
+
+        // Comment lines (": keep-alive") carry no data
+        if (line.startsWith(':'))
+        {
+            return;
+        }
+
+        auto field = line;
+        QByteArrayView value;
+        const auto colon = line.indexOf(':');
+        if (colon >= 0)
+        {
+            field = line.first(colon);
+            value = line.sliced(colon + 1);
+            if (value.startsWith(' '))
+            {
+                value = value.sliced(1);
+            }
+        }
+
+        if (field == "data")
+        {
+            if (m_has_data)
+            {
+                m_current.data.append('\n');
+            }
+            m_current.data.append(value);
+            m_has_data = true;
+        }
+        else if (field == "event")
+        {
+            m_current.event = value.toByteArray();
+        }
+    }
+
+} // namespace llm
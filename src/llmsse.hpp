@@ -0,0 +1,36 @@
+#ifndef LLMSSE_HPP
+#define LLMSSE_HPP
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+
+namespace llm
+{
+
+    struct s_sse_event
+    {
+        QByteArray event;
+        QByteArray data;
+    };
+
+    // Incremental text/event-stream parser. Bytes can be fed in arbitrary
+    // slices as they arrive from the socket; an event is only returned once
+    // its terminating blank line has been seen.
+    class c_sse_parser
+    {
+    public:
+        [[nodiscard]] auto feed(QByteArrayView bytes) -> QList<s_sse_event>;
+        void reset();
+
+    private:
+        void process_line(QByteArrayView line, QList<s_sse_event> &events);
+
+        QByteArray m_buffer;
+        s_sse_event m_current;
+        bool m_has_data{ false };
+    };
+
+} // namespace llm
+
+#endif // LLMSSE_HPP
@@ -0,0 +1,251 @@
+#include "../src/llmclient.hpp"
+#include "../src/llmjson.hpp"
+#include "mockprovider.hpp"
+#include <QString>
+#include <QTest>
+#include <memory>
+
+// Offline benchmarks against the local mock provider. Run with e.g.
+// `bench_llmclient -iterations 200` or `-tickcounter` for stable numbers.
+class c_bench_llm_client : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void bench_build_payload_data();
+    void bench_build_payload();
+    void bench_parse_response_data();
+    void bench_parse_response();
+    void bench_extract_text_data();
+    void bench_extract_text();
+    void bench_send_message_data();
+    void bench_send_message();
+    void bench_concurrent_throughput_data();
+    void bench_concurrent_throughput();
+
+private:
+    static void add_provider_rows();
+    auto create_config(llm::e_provider provider) -> llm::s_config;
+
+    std::unique_ptr<c_mock_provider> m_mock;
+};
+
+void c_bench_llm_client::initTestCase()
+{
+    m_mock = std::make_unique<c_mock_provider>();
+    QVERIFY(m_mock->listen());
+}
+
+void c_bench_llm_client::add_provider_rows()
+{
+    QTest::addColumn<int>("provider");
+    for (const auto provider : { llm::e_provider::OpenAI, llm::e_provider::Anthropic, llm::e_provider::Gemini })
+    {
+        QTest::addRow("%s", llm::provider_name(provider).data()) << static_cast<int>(provider);
+    }
+}
+
+void c_bench_llm_client::bench_build_payload_data()
+{
+    add_provider_rows();
+}
+
+void c_bench_llm_client::bench_build_payload()
+{
+    QFETCH(int, provider);
+    llm::c_client client(create_config(static_cast<llm::e_provider>(provider)));
+    const auto prompt = QStringLiteral("How many kilometres are there in a marathon?");
+
+    QBENCHMARK
+    {
+        auto payload = client.build_payload(prompt, true);
+        Q_UNUSED(payload);
+    }
+}
+
+void c_bench_llm_client::bench_parse_response_data()
+{
+    add_provider_rows();
+}
+
+void c_bench_llm_client::bench_parse_response()
+{
+    QFETCH(int, provider);
+    const auto config = create_config(static_cast<llm::e_provider>(provider));
+    llm::c_client client(config);
+
+    // Capture a real body from the mock once, then parse it repeatedly
+    QNetworkAccessManager manager;
+    QNetworkRequest request = client.build_request();
+    auto *reply = manager.post(request, client.build_payload(QStringLiteral("test query")));
+    QVERIFY(QTest::qWaitFor([reply]()
+                            { return reply->isFinished(); }));
+    const auto body = reply->readAll();
+    reply->deleteLater();
+    QVERIFY(client.parse_response(body).has_value());
+
+    QBENCHMARK
+    {
+        auto result = client.parse_response(body);
+        Q_UNUSED(result);
+    }
+}
+
+void c_bench_llm_client::bench_extract_text_data()
+{
+    // A long answer followed by the metadata providers attach to it
+    QJsonArray logprobs;
+    for (int i = 0; i < 200; ++i)
+    {
+        QJsonObject token;
+        token[QStringLiteral("token")] = QStringLiteral("tok%1").arg(i);
+        token[QStringLiteral("logprob")] = -0.01 * i;
+        token[QStringLiteral("bytes")] = QJsonArray{ 116, 111, 107 };
+        logprobs.append(token);
+    }
+    QJsonObject message;
+    message[QStringLiteral("role")] = QStringLiteral("assistant");
+    message[QStringLiteral("content")] = QStringLiteral("A marathon is 42.195 kilometres long. ").repeated(20);
+    QJsonObject choice;
+    choice[QStringLiteral("index")] = 0;
+    choice[QStringLiteral("message")] = message;
+    choice[QStringLiteral("logprobs")] = QJsonObject{ { QStringLiteral("content"), logprobs } };
+    choice[QStringLiteral("finish_reason")] = QStringLiteral("stop");
+    QJsonObject usage;
+    usage[QStringLiteral("prompt_tokens")] = 12;
+    usage[QStringLiteral("completion_tokens")] = 200;
+    QJsonObject verbose;
+    verbose[QStringLiteral("id")] = QStringLiteral("chatcmpl-bench");
+    verbose[QStringLiteral("choices")] = QJsonArray{ choice };
+    verbose[QStringLiteral("usage")] = usage;
+
+    const auto delta = QByteArray(R"({"id":"chatcmpl-bench","object":"chat.completion.chunk","choices":[{"index":0,"delta":{"content":" kilometres"},"finish_reason":null}]})");
+
+    QTest::addColumn<QByteArray>("body");
+    QTest::addColumn<QByteArray>("path");
+    QTest::addColumn<bool>("pull");
+    const auto body = QJsonDocument(verbose).toJson(QJsonDocument::Compact);
+    QTest::addRow("verbose-dom") << body << QByteArray("choices.0.message.content") << false;
+    QTest::addRow("verbose-pull") << body << QByteArray("choices.0.message.content") << true;
+    QTest::addRow("delta-dom") << delta << QByteArray("choices.0.delta.content") << false;
+    QTest::addRow("delta-pull") << delta << QByteArray("choices.0.delta.content") << true;
+}
+
+void c_bench_llm_client::bench_extract_text()
+{
+    QFETCH(QByteArray, body);
+    QFETCH(QByteArray, path);
+    QFETCH(bool, pull);
+
+    if (pull)
+    {
+        QBENCHMARK
+        {
+            auto text = llm::extract_json_string(body, path);
+            Q_UNUSED(text);
+        }
+        return;
+    }
+
+    // What parse_response did before the pull extractor: DOM, objects, then the string
+    const auto steps = path.split('.');
+    QBENCHMARK
+    {
+        QJsonValue value = QJsonDocument::fromJson(body).object();
+        for (const auto &step : steps)
+        {
+            bool is_index = false;
+            const auto index = step.toInt(&is_index);
+            value = is_index ? value.toArray()[index] : value.toObject()[QString::fromLatin1(step)];
+        }
+        auto text = value.toString();
+        Q_UNUSED(text);
+    }
+}
+
+void c_bench_llm_client::bench_send_message_data()
+{
+    QTest::addColumn<int>("latency_ms");
+    QTest::addColumn<bool>("stream");
+    QTest::addRow("immediate") << 0 << false;
+    QTest::addRow("immediate-stream") << 0 << true;
+    QTest::addRow("20ms") << 20 << false;
+}
+
+void c_bench_llm_client::bench_send_message()
+{
+    QFETCH(int, latency_ms);
+    QFETCH(bool, stream);
+    m_mock->options().latency = std::chrono::milliseconds(latency_ms);
+
+    // One client across iterations, so later rounds reuse the kept-alive connection
+    llm::c_client client(create_config(llm::e_provider::OpenAI));
+
+    QBENCHMARK
+    {
+        std::optional<llm::t_result> result;
+        if (stream)
+        {
+            client.send_message_stream(QStringLiteral("test query"), [](const QString &) {}, [&result](llm::t_result reply)
+                                       { result = std::move(reply); });
+        }
+        else
+        {
+            client.send_message_async(QStringLiteral("test query"), [&result](llm::t_result reply)
+                                      { result = std::move(reply); });
+        }
+        QVERIFY(QTest::qWaitFor([&result]()
+                                { return result.has_value(); }));
+        QVERIFY(result->has_value());
+    }
+
+    m_mock->options().latency = std::chrono::milliseconds(0);
+}
+
+void c_bench_llm_client::bench_concurrent_throughput_data()
+{
+    QTest::addColumn<int>("concurrency");
+    QTest::addRow("8") << 8;
+    QTest::addRow("32") << 32;
+}
+
+void c_bench_llm_client::bench_concurrent_throughput()
+{
+    QFETCH(int, concurrency);
+    m_mock->options().latency = std::chrono::milliseconds(10);
+    llm::c_client client(create_config(llm::e_provider::OpenAI));
+
+    QBENCHMARK
+    {
+        int answered = 0;
+        for (int i = 0; i < concurrency; ++i)
+        {
+            client.send_message_async(QStringLiteral("query %1").arg(i), [&answered](llm::t_result reply)
+                                      {
+                                      if (reply.has_value())
+                                      {
+                                          ++answered;
+                                      } });
+        }
+        QVERIFY(QTest::qWaitFor([&answered, concurrency]()
+                                { return answered == concurrency; }));
+    }
+
+    m_mock->options().latency = std::chrono::milliseconds(0);
+}
+
+auto c_bench_llm_client::create_config(llm::e_provider provider) -> llm::s_config
+{
+    llm::s_config config;
+    config.provider = provider;
+    config.apiKey = QStringLiteral("bench-key");
+    config.model = QStringLiteral("bench-model");
+    config.max_tokens = 150;
+    config.timeout_ms = 10000;
+    config.base_url = m_mock->base_url();
+    return config;
+}
+
+QTEST_MAIN(c_bench_llm_client)
+#include "bench_llmclient.moc"
@@ -0,0 +1,314 @@
+#include "mockprovider.hpp"
+
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <memory>
+
+namespace
+{
+    auto reason_phrase(int status) -> QByteArray
+    {
+        switch (status)
+        {
+        case 200:
+            return "OK";
+        case 401:
+            return "Unauthorized";
+        case 403:
+            return "Forbidden";
+        case 429:
+            return "Too Many Requests";
+        case 500:
+            return "Internal Server Error";
+        case 503:
+            return "Service Unavailable";
+        case 529:
+            return "Overloaded";
+        default:
+            return "Error";
+        }
+    }
+
+    auto text_json(const QString &text) -> QJsonObject
+    {
+        QJsonObject part;
+        part[QStringLiteral("text")] = text;
+        return part;
+    }
+
+    auto gemini_json(const QString &text) -> QJsonObject
+    {
+        QJsonObject content;
+        content[QStringLiteral("parts")] = QJsonArray{ text_json(text) };
+        QJsonObject candidate;
+        candidate[QStringLiteral("content")] = content;
+        QJsonObject json;
+        json[QStringLiteral("candidates")] = QJsonArray{ candidate };
+        return json;
+    }
+
+    auto compact(const QJsonObject &json) -> QByteArray
+    {
+        return QJsonDocument(json).toJson(QJsonDocument::Compact);
+    }
+} // namespace
+
+c_mock_provider::c_mock_provider(s_mock_options options)
+    : m_options(std::move(options))
+{
+    QObject::connect(&m_server, &QTcpServer::newConnection, &m_server, [this]()
+                     {
+                     while (auto *socket = m_server.nextPendingConnection())
+                     {
+                         QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+                         serve(socket);
+                     } });
+    QObject::connect(&m_local_server, &QLocalServer::newConnection, &m_local_server, [this]()
+                     {
+                     while (auto *socket = m_local_server.nextPendingConnection())
+                     {
+                         QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+                         serve(socket);
+                     } });
+}
+
+auto c_mock_provider::listen() -> bool
+{
+    return m_server.listen(QHostAddress::LocalHost, 0);
+}
+
+auto c_mock_provider::base_url() const -> QString
+{
+    return QStringLiteral("http://127.0.0.1:%1").arg(m_server.serverPort());
+}
+
+auto c_mock_provider::listen_local(const QString &path) -> bool
+{
+    QLocalServer::removeServer(path);
+    return m_local_server.listen(path);
+}
+
+auto c_mock_provider::local_url() const -> QString
+{
+    return QStringLiteral("unix://") + m_local_server.fullServerName();
+}
+
+auto c_mock_provider::requests() const -> int
+{
+    return m_requests;
+}
+
+auto c_mock_provider::options() -> s_mock_options &
+{
+    return m_options;
+}
+
+void c_mock_provider::serve(QIODevice *socket)
+{
+    // Clients keep the connection alive, so several requests may arrive on it
+    auto buffer = std::make_shared<QByteArray>();
+    QObject::connect(socket, &QIODevice::readyRead, socket, [this, socket, buffer]()
+                     {
+                     buffer->append(socket->readAll());
+                     for (;;)
+                     {
+                         const auto header_end = buffer->indexOf("\r\n\r\n");
+                         if (header_end < 0)
+                         {
+                             return;
+                         }
+
+                         const auto lines = buffer->left(header_end).split('\n');
+                         const auto request_line = lines.first().trimmed().split(' ');
+                         qsizetype content_length = 0;
+                         for (const auto &line : lines)
+                         {
+                             const auto colon = line.indexOf(':');
+                             if (colon > 0 && line.left(colon).trimmed().compare("content-length", Qt::CaseInsensitive) == 0)
+                             {
+                                 content_length = line.mid(colon + 1).trimmed().toLongLong();
+                             }
+                         }
+
+                         const auto body_start = header_end + 4;
+                         if (buffer->size() < body_start + content_length)
+                         {
+                             return;
+                         }
+
+                         const auto body = buffer->mid(body_start, content_length);
+                         buffer->remove(0, body_start + content_length);
+                         respond(socket, request_line.value(1), body);
+                     } });
+}
+
+void c_mock_provider::respond(QIODevice *socket, const QByteArray &path, const QByteArray &body)
+{
+    ++m_requests;
+
+    auto dialect = e_dialect::openai;
+    if (path.contains("/messages"))
+    {
+        dialect = e_dialect::anthropic;
+    }
+    else if (path.contains(":generateContent") || path.contains(":streamGenerateContent"))
+    {
+        dialect = e_dialect::gemini;
+    }
+
+    const bool stream = path.contains(":streamGenerateContent") || QJsonDocument::fromJson(body).object()[QStringLiteral("stream")].toBool();
+
+    int status = m_options.error_status;
+    if (m_options.rate_limited_requests > 0)
+    {
+        --m_options.rate_limited_requests;
+        status = 429;
+    }
+
+    QTimer::singleShot(m_options.latency, socket, [this, socket, dialect, stream, status]()
+                       {
+                       if (status != 0)
+                       {
+                           send_error(socket, status);
+                       }
+                       else if (stream)
+                       {
+                           send_stream(socket, dialect);
+                       }
+                       else
+                       {
+                           send_completion(socket, dialect);
+                       } });
+}
+
+void c_mock_provider::send_error(QIODevice *socket, int status)
+{
+    QJsonObject error;
+    error[QStringLiteral("message")] = QString::fromLatin1(reason_phrase(status));
+    QJsonObject json;
+    json[QStringLiteral("error")] = error;
+    const auto payload = compact(json);
+
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + reason_phrase(status) + "\r\n";
+    response += "Content-Type: application/json\r\n";
+    if (status == 429)
+    {
+        response += "Retry-After: " + QByteArray::number(m_options.retry_after_seconds) + "\r\n";
+    }
+    response += "Content-Length: " + QByteArray::number(payload.size()) + "\r\n\r\n";
+    response += payload;
+    socket->write(response);
+}
+
+void c_mock_provider::send_completion(QIODevice *socket, e_dialect dialect)
+{
+    QJsonObject json;
+    switch (dialect)
+    {
+    case e_dialect::openai:
+    {
+        QJsonObject message;
+        message[QStringLiteral("role")] = QStringLiteral("assistant");
+        message[QStringLiteral("content")] = m_options.answer;
+        QJsonObject choice;
+        choice[QStringLiteral("message")] = message;
+        json[QStringLiteral("choices")] = QJsonArray{ choice };
+        break;
+    }
+    case e_dialect::anthropic:
+    {
+        auto part = text_json(m_options.answer);
+        part[QStringLiteral("type")] = QStringLiteral("text");
+        json[QStringLiteral("content")] = QJsonArray{ part };
+        break;
+    }
+    case e_dialect::gemini:
+        json = gemini_json(m_options.answer);
+        break;
+    }
+
+    const auto payload = compact(json);
+    QByteArray response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + QByteArray::number(payload.size()) + "\r\n\r\n";
+    response += payload;
+    socket->write(response);
+}
+
+void c_mock_provider::send_stream(QIODevice *socket, e_dialect dialect)
+{
+    socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\n\r\n");
+
+    // One chunk per event, spaced by chunk_interval, then the terminating chunk
+    auto events = stream_events(dialect);
+    events.append(QByteArray());
+    QPointer<QIODevice> guard(socket);
+    for (qsizetype index = 0; index < events.size(); ++index)
+    {
+        const QByteArray chunk = QByteArray::number(events[index].size(), 16) + "\r\n" + events[index] + "\r\n";
+        QTimer::singleShot(m_options.chunk_interval * index, socket, [guard, chunk]()
+                           {
+                           if (guard)
+                           {
+                               guard->write(chunk);
+                           } });
+    }
+}
+
+auto c_mock_provider::stream_events(e_dialect dialect) const -> QList<QByteArray>
+{
+    // Word by word, keeping the separating spaces so the deltas add up to the answer
+    QList<QString> deltas;
+    const auto words = m_options.answer.split(QLatin1Char(' '));
+    for (qsizetype index = 0; index < words.size(); ++index)
+    {
+        deltas.append(index == 0 ? words[index] : QString(QLatin1Char(' ') + words[index]));
+    }
+
+    QList<QByteArray> events;
+    for (const auto &delta : std::as_const(deltas))
+    {
+        switch (dialect)
+        {
+        case e_dialect::openai:
+        {
+            QJsonObject content;
+            content[QStringLiteral("content")] = delta;
+            QJsonObject choice;
+            choice[QStringLiteral("delta")] = content;
+            QJsonObject json;
+            json[QStringLiteral("choices")] = QJsonArray{ choice };
+            events.append(QByteArray("data: " + compact(json) + "\n\n"));
+            break;
+        }
+        case e_dialect::anthropic:
+        {
+            auto text = text_json(delta);
+            text[QStringLiteral("type")] = QStringLiteral("text_delta");
+            QJsonObject json;
+            json[QStringLiteral("type")] = QStringLiteral("content_block_delta");
+            json[QStringLiteral("delta")] = text;
+            events.append(QByteArray("event: content_block_delta\ndata: " + compact(json) + "\n\n"));
+            break;
+        }
+        case e_dialect::gemini:
+            events.append(QByteArray("data: " + compact(gemini_json(delta)) + "\n\n"));
+            break;
+        }
+    }
+
+    if (dialect == e_dialect::openai)
+    {
+        events.append("data: [DONE]\n\n");
+    }
+    else if (dialect == e_dialect::anthropic)
+    {
+        events.append("event: message_stop\ndata: {\"type\":\"message_stop\"}\n\n");
+    }
+    return events;
+}
@@ -0,0 +1,66 @@
+#ifndef MOCKPROVIDER_HPP
+#define MOCKPROVIDER_HPP
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QLocalServer>
+#include <QString>
+#include <QTcpServer>
+
+#include <chrono>
+#include <cstdint>
+
+// Behaviour of the mock provider; may be changed between requests
+struct s_mock_options
+{
+    // Delay before the response headers are sent
+    std::chrono::milliseconds latency{ 0 };
+    // Delay between streamed events
+    std::chrono::milliseconds chunk_interval{ 0 };
+    // Answer every request with this HTTP status instead of a completion, e.g. 401 or 500
+    int error_status{ 0 };
+    // Number of requests answered with 429 before the mock recovers
+    int rate_limited_requests{ 0 };
+    int retry_after_seconds{ 0 };
+    QString answer{ QStringLiteral("The quick brown fox jumps over the lazy dog.") };
+};
+
+// Plain HTTP/1.1 stand-in for the OpenAI, Anthropic and Gemini APIs. The
+// dialect is chosen from the request path, streaming from the payload, so a
+// client only needs its base_url pointed at base_url() or local_url().
+class c_mock_provider
+{
+public:
+    explicit c_mock_provider(s_mock_options options = {});
+
+    // Listens on an ephemeral loopback port
+    [[nodiscard]] auto listen() -> bool;
+    [[nodiscard]] auto base_url() const -> QString;
+    // Listens on a Unix domain socket at the given path as well
+    [[nodiscard]] auto listen_local(const QString &path) -> bool;
+    [[nodiscard]] auto local_url() const -> QString;
+    [[nodiscard]] auto requests() const -> int;
+    [[nodiscard]] auto options() -> s_mock_options &;
+
+private:
+    enum class e_dialect : std::uint8_t
+    {
+        openai,
+        anthropic,
+        gemini
+    };
+
+    void serve(QIODevice *socket);
+    void respond(QIODevice *socket, const QByteArray &path, const QByteArray &body);
+    void send_error(QIODevice *socket, int status);
+    void send_completion(QIODevice *socket, e_dialect dialect);
+    void send_stream(QIODevice *socket, e_dialect dialect);
+    [[nodiscard]] auto stream_events(e_dialect dialect) const -> QList<QByteArray>;
+
+    QTcpServer m_server;
+    QLocalServer m_local_server;
+    s_mock_options m_options;
+    int m_requests{ 0 };
+};
+
+#endif // MOCKPROVIDER_HPP
@@ -0,0 +1,253 @@
+#include "../src/llmcache.hpp"
+#include "../src/llmdiskcache.hpp"
+#include "../src/llmsession.hpp"
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QTemporaryDir>
+#include <QTest>
+
+class c_test_llm_cache : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void test_key_normalization();
+    void test_lru_eviction();
+    void test_ttl_expiry();
+    void test_disabled_cache();
+    void test_disk_cache_persistence();
+    void test_disk_cache_torn_record();
+    void test_disk_cache_torn_middle();
+    void test_disk_cache_open_retry();
+    void test_disk_cache_compaction();
+    void test_disk_cache_shared();
+    void test_session();
+};
+
+void c_test_llm_cache::test_key_normalization()
+{
+    llm::s_config config;
+    config.model = QStringLiteral("gpt-4");
+
+    auto key = llm::c_response_cache::make_key(config, QStringLiteral("Convert  5 miles to KM"));
+    QCOMPARE(key, llm::c_response_cache::make_key(config, QStringLiteral(" convert 5 miles to km ")));
+
+    // Anything that changes the answer must change the key
+    auto other_config = config;
+    other_config.max_tokens = 300;
+    QVERIFY(key != llm::c_response_cache::make_key(other_config, QStringLiteral("convert 5 miles to km")));
+    other_config = config;
+    other_config.provider = llm::e_provider::Groq;
+    QVERIFY(key != llm::c_response_cache::make_key(other_config, QStringLiteral("convert 5 miles to km")));
+
+    // A follow-up depends on the conversation before it
+    const QList<llm::s_message> history{ { .role = QStringLiteral("user"), .content = QStringLiteral("weather in Paris?") },
+                                         { .role = QStringLiteral("assistant"), .content = QStringLiteral("20 degrees") } };
+    QCOMPARE(llm::c_response_cache::make_key(config, {}, QStringLiteral("convert 5 miles to km")), key);
+    QVERIFY(key != llm::c_response_cache::make_key(config, history, QStringLiteral("convert 5 miles to km")));
+}
+
+void c_test_llm_cache::test_lru_eviction()
+{
+    llm::c_response_cache cache(2, std::chrono::hours(1));
+    cache.insert(QStringLiteral("a"), QStringLiteral("1"));
+    cache.insert(QStringLiteral("b"), QStringLiteral("2"));
+
+    // Touching "a" makes "b" the eviction candidate
+    QCOMPARE(cache.lookup(QStringLiteral("a")).value(), QStringLiteral("1"));
+    cache.insert(QStringLiteral("c"), QStringLiteral("3"));
+
+    QCOMPARE(cache.size(), 2);
+    QVERIFY(!cache.lookup(QStringLiteral("b")).has_value());
+    QCOMPARE(cache.lookup(QStringLiteral("c")).value(), QStringLiteral("3"));
+
+    cache.set_limits(1, std::chrono::hours(1));
+    QCOMPARE(cache.size(), 1);
+    QVERIFY(cache.lookup(QStringLiteral("c")).has_value());
+}
+
+void c_test_llm_cache::test_ttl_expiry()
+{
+    llm::c_response_cache cache(4, std::chrono::milliseconds(20));
+    cache.insert(QStringLiteral("a"), QStringLiteral("1"));
+    QVERIFY(cache.lookup(QStringLiteral("a")).has_value());
+
+    QTest::qWait(40);
+    QVERIFY(!cache.lookup(QStringLiteral("a")).has_value());
+    QCOMPARE(cache.size(), 0);
+}
+
+void c_test_llm_cache::test_disabled_cache()
+{
+    llm::c_response_cache cache(0, std::chrono::hours(1));
+    cache.insert(QStringLiteral("a"), QStringLiteral("1"));
+    QVERIFY(!cache.lookup(QStringLiteral("a")).has_value());
+}
+
+void c_test_llm_cache::test_disk_cache_persistence()
+{
+    QTemporaryDir dir;
+    const auto path = dir.filePath(QStringLiteral("answers.cache"));
+
+    {
+        llm::c_disk_cache cache(path, 1024 * 1024, std::chrono::hours(1));
+        cache.insert(QStringLiteral("a"), QStringLiteral("first"));
+        cache.insert(QStringLiteral("b"), QStringLiteral("second"));
+        cache.insert(QStringLiteral("a"), QStringLiteral("updated"));
+    }
+
+    // A fresh instance, as after a krunner restart, sees the latest records
+    llm::c_disk_cache cache(path, 1024 * 1024, std::chrono::hours(1));
+    QCOMPARE(cache.lookup(QStringLiteral("a")).value(), QStringLiteral("updated"));
+    QCOMPARE(cache.lookup(QStringLiteral("b")).value(), QStringLiteral("second"));
+    QVERIFY(!cache.lookup(QStringLiteral("c")).has_value());
+    QCOMPARE(cache.size(), 2);
+}
+
+void c_test_llm_cache::test_disk_cache_torn_record()
+{
+    QTemporaryDir dir;
+    const auto path = dir.filePath(QStringLiteral("answers.cache"));
+
+    {
+        llm::c_disk_cache cache(path, 1024 * 1024, std::chrono::hours(1));
+        cache.insert(QStringLiteral("a"), QStringLiteral("kept"));
+        cache.insert(QStringLiteral("b"), QStringLiteral("torn"));
+    }
+
+    // Simulate a crash in the middle of the last append
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() - 2));
+    file.close();
+
+    llm::c_disk_cache cache(path, 1024 * 1024, std::chrono::hours(1));
+    QCOMPARE(cache.lookup(QStringLiteral("a")).value(), QStringLiteral("kept"));
+    QVERIFY(!cache.lookup(QStringLiteral("b")).has_value());
+
+    // Appends after the truncated tail are readable again
+    cache.insert(QStringLiteral("b"), QStringLiteral("rewritten"));
+    QCOMPARE(cache.lookup(QStringLiteral("b")).value(), QStringLiteral("rewritten"));
+}
+
+void c_test_llm_cache::test_disk_cache_torn_middle()
+{
+    QTemporaryDir dir;
+    const auto path = dir.filePath(QStringLiteral("answers.cache"));
+
+    {
+        llm::c_disk_cache cache(path, 1024 * 1024, std::chrono::hours(1));
+        cache.insert(QStringLiteral("a"), QStringLiteral("torn"));
+        cache.insert(QStringLiteral("b"), QStringLiteral("appended later"));
+    }
+
+    // A crash tore the first record, another process appended after it; the
+    // first value byte sits past the file header, the record header and the key
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    const auto size = file.size();
+    QVERIFY(file.seek(16 + 24 + 1));
+    QVERIFY(file.write("T") == 1);
+    file.close();
+
+    llm::c_disk_cache cache(path, 1024 * 1024, std::chrono::hours(1));
+    QVERIFY(!cache.lookup(QStringLiteral("a")).has_value());
+    QCOMPARE(cache.lookup(QStringLiteral("b")).value(), QStringLiteral("appended later"));
+    QCOMPARE(cache.size(), 1);
+    QCOMPARE(cache.file_size(), size);
+}
+
+void c_test_llm_cache::test_disk_cache_open_retry()
+{
+    QTemporaryDir dir;
+    const auto path = dir.filePath(QStringLiteral("answers.cache"));
+
+    // Something else sits at the path for a while
+    QVERIFY(QDir().mkpath(path));
+    llm::c_disk_cache cache(path, 1024 * 1024, std::chrono::hours(1));
+    cache.insert(QStringLiteral("a"), QStringLiteral("lost"));
+    QVERIFY(!cache.lookup(QStringLiteral("a")).has_value());
+
+    // A failed open is tried again on the next use
+    QVERIFY(QDir().rmdir(path));
+    cache.insert(QStringLiteral("a"), QStringLiteral("stored"));
+    QCOMPARE(cache.lookup(QStringLiteral("a")).value(), QStringLiteral("stored"));
+}
+
+void c_test_llm_cache::test_disk_cache_compaction()
+{
+    QTemporaryDir dir;
+    const auto path = dir.filePath(QStringLiteral("answers.cache"));
+    constexpr qint64 max_bytes = 4096;
+
+    llm::c_disk_cache cache(path, max_bytes, std::chrono::hours(1));
+    const QString response(200, QLatin1Char('x'));
+    for (int i = 0; i < 100; ++i)
+    {
+        cache.insert(QStringLiteral("key %1").arg(i), response);
+        QVERIFY(cache.file_size() <= max_bytes);
+    }
+
+    // The newest entries survive compaction
+    QCOMPARE(cache.lookup(QStringLiteral("key 99")).value(), response);
+    QVERIFY(!cache.lookup(QStringLiteral("key 0")).has_value());
+}
+
+void c_test_llm_cache::test_disk_cache_shared()
+{
+    QTemporaryDir dir;
+    const auto path = dir.filePath(QStringLiteral("answers.cache"));
+
+    // Two processes on one file, e.g. KRunner and plasmashell
+    llm::c_disk_cache first(path, 1024 * 1024, std::chrono::hours(1));
+    llm::c_disk_cache second(path, 1024 * 1024, std::chrono::hours(1));
+    first.insert(QStringLiteral("a"), QStringLiteral("from first"));
+    QCOMPARE(second.lookup(QStringLiteral("a")).value(), QStringLiteral("from first"));
+
+    // A compaction elsewhere neither loses nor swallows the other's records
+    second.insert(QStringLiteral("b"), QStringLiteral("from second"));
+    second.compact();
+    first.insert(QStringLiteral("c"), QStringLiteral("after compaction"));
+
+    llm::c_disk_cache reopened(path, 1024 * 1024, std::chrono::hours(1));
+    QCOMPARE(reopened.size(), 3);
+    QCOMPARE(reopened.lookup(QStringLiteral("c")).value(), QStringLiteral("after compaction"));
+
+    // A file removed and created anew has the same generation; the inode tells it apart
+    QVERIFY(QFile::remove(path));
+    llm::c_disk_cache recreated(path, 1024 * 1024, std::chrono::hours(1));
+    recreated.insert(QStringLiteral("d"), QStringLiteral("in the new file"));
+    first.insert(QStringLiteral("e"), QStringLiteral("after removal"));
+    QCOMPARE(recreated.lookup(QStringLiteral("e")).value(), QStringLiteral("after removal"));
+    QCOMPARE(first.lookup(QStringLiteral("d")).value(), QStringLiteral("in the new file"));
+}
+
+void c_test_llm_cache::test_session()
+{
+    using namespace std::chrono_literals;
+    const auto start = llm::c_session::t_clock::now();
+    llm::c_session session(4, 5min);
+
+    session.add_turn(QStringLiteral("weather in Paris?"), QStringLiteral("20 degrees"), start);
+    QCOMPARE(session.history(start + 1min).size(), 2);
+    QCOMPARE(session.history(start + 1min).last().role, QStringLiteral("assistant"));
+
+    // Full: the older half goes at once, keeping the newest turns
+    for (int turn = 1; turn < 5; ++turn)
+    {
+        session.add_turn(QStringLiteral("question %1").arg(turn), QStringLiteral("answer %1").arg(turn), start + 1min);
+    }
+    QCOMPARE(session.turns(), 3);
+    QCOMPARE(session.history(start + 1min).first().content, QStringLiteral("question 2"));
+
+    // Idle for too long: the next question starts afresh
+    QVERIFY(session.history(start + 7min).isEmpty());
+
+    session.set_limits(0, 5min);
+    session.add_turn(QStringLiteral("weather in Paris?"), QStringLiteral("20 degrees"), start);
+    QCOMPARE(session.turns(), 0);
+}
+
+QTEST_GUILESS_MAIN(c_test_llm_cache)
+#include "test_llmcache.moc"
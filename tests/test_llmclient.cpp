@@ -1,5 +1,16 @@
 #include "../src/llmclient.hpp"
+#include "../src/llmengine.hpp"
+#include "../src/llmhealth.hpp"
+#include "../src/llmjson.hpp"
+#include "../src/llmmetrics.hpp"
+#include "../src/llmratelimit.hpp"
+#include "mockprovider.hpp"
+#include <QElapsedTimer>
 #include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
 #include <QString>
 #include <QTest>
 #include <memory>
@@ -9,19 +20,38 @@ class c_test_llm_client : public QObject
     Q_OBJECT
 
 private Q_SLOTS:
-    void init_test_case();
+    void initTestCase();
     void test_config_creation();
     void test_client_creation();
     void test_error_handling();
+    void test_mock_round_trip_data();
+    void test_mock_round_trip();
+    void test_rate_limit_retry();
+    void test_layered_deadlines();
+    void test_local_provider();
+    void test_reconfigure();
+    void test_follow_up_payload();
     void test_provider_endpoints();
     void test_request_building();
-    void cleanup_test_case();
+    void test_shared_connection_pool();
+    void test_async_cancellation();
+    void test_sse_parser();
+    void test_stream_event_parsing();
+    void test_json_extraction();
+    void test_latency_window();
+    void test_circuit_breaker();
+    void test_auth_errors();
+    void test_cascade();
+    void test_latency_histogram();
+    void test_rate_limiter();
+    void test_rate_limit_headers();
+    void cleanupTestCase();
 
 private:
     auto create_test_config() -> llm::s_config;
 };
 
-void c_test_llm_client::init_test_case()
+void c_test_llm_client::initTestCase()
 {
     // Setup test environment
 }
@@ -52,22 +82,293 @@ void c_test_llm_client::test_client_creation()
 
 void c_test_llm_client::test_error_handling()
 {
-    // Test invalid config
+    // The mock rejects the key like the real API would, without leaving the machine
+    c_mock_provider mock({ .error_status = 401 });
+    QVERIFY(mock.listen());
+
     llm::s_config invalid_config;
     invalid_config.apiKey = QString(); // Empty API key
     invalid_config.provider = llm::e_provider::OpenAI;
     invalid_config.model = QStringLiteral("gpt-4");
     invalid_config.max_tokens = 100;
     invalid_config.timeout_ms = 1000; // Short timeout for testing
+    invalid_config.base_url = mock.base_url();
 
     auto client = std::make_unique<llm::c_client>(invalid_config);
-
-    // This will fail with network error since API key is invalid
-    // We're just testing that the error handling works
     auto result = client->send_message(QStringLiteral("test query"));
 
-    // Should return an error
     QVERIFY(!result.has_value());
+    QCOMPARE(result.error().code, llm::e_error_code::invalid_api_key);
+}
+
+void c_test_llm_client::test_mock_round_trip_data()
+{
+    QTest::addColumn<int>("provider");
+    QTest::addColumn<bool>("stream");
+
+    for (const auto provider : { llm::e_provider::OpenAI, llm::e_provider::Anthropic, llm::e_provider::Gemini })
+    {
+        const auto name = llm::provider_name(provider);
+        QTest::addRow("%s", name.data()) << static_cast<int>(provider) << false;
+        QTest::addRow("%s-stream", name.data()) << static_cast<int>(provider) << true;
+    }
+}
+
+void c_test_llm_client::test_mock_round_trip()
+{
+    QFETCH(int, provider);
+    QFETCH(bool, stream);
+
+    c_mock_provider mock;
+    QVERIFY(mock.listen());
+
+    auto config = create_test_config();
+    config.provider = static_cast<llm::e_provider>(provider);
+    config.base_url = mock.base_url();
+    llm::c_client client(config);
+
+    std::optional<llm::t_result> result;
+    QString streamed;
+    if (stream)
+    {
+        client.send_message_stream(QStringLiteral("test query"), [&streamed](const QString &chunk)
+                                   { streamed += chunk; }, [&result](llm::t_result reply)
+                                   { result = std::move(reply); });
+    }
+    else
+    {
+        client.send_message_async(QStringLiteral("test query"), [&result](llm::t_result reply)
+                                  { result = std::move(reply); });
+    }
+
+    QTRY_VERIFY(result.has_value());
+    QVERIFY(result->has_value());
+    QCOMPARE(result->value(), mock.options().answer);
+    if (stream)
+    {
+        QCOMPARE(streamed, mock.options().answer);
+    }
+}
+
+void c_test_llm_client::test_rate_limit_retry()
+{
+    // The first request is throttled; the client waits Retry-After and tries again
+    c_mock_provider mock({ .rate_limited_requests = 1, .retry_after_seconds = 1 });
+    QVERIFY(mock.listen());
+
+    // A key of its own keeps the Retry-After block away from the other tests
+    auto config = create_test_config();
+    config.apiKey = QStringLiteral("throttled-key");
+    config.base_url = mock.base_url();
+    config.timeout_ms = 5000;
+    llm::c_client client(config);
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    auto result = client.send_message(QStringLiteral("test query"));
+
+    QVERIFY(result.has_value());
+    QCOMPARE(mock.requests(), 2);
+    QVERIFY(elapsed.elapsed() >= 1000);
+
+    // Without time left for the retry the throttling is reported
+    mock.options().rate_limited_requests = 1;
+    mock.options().retry_after_seconds = 10;
+    result = client.send_message(QStringLiteral("test query"));
+    QVERIFY(!result.has_value());
+    QCOMPARE(result.error().code, llm::e_error_code::rate_limited);
+}
+
+void c_test_llm_client::test_layered_deadlines()
+{
+    c_mock_provider mock;
+    QVERIFY(mock.listen());
+
+    auto config = create_test_config();
+    config.base_url = mock.base_url();
+    config.timeout_ms = 10000;
+    config.first_byte_timeout_ms = 300;
+    config.idle_timeout_ms = 300;
+    llm::c_client client(config);
+
+    const auto stream = [&client]()
+    {
+        std::optional<llm::t_result> result;
+        client.send_message_stream(QStringLiteral("test query"), [](const QString &) {}, [&result](llm::t_result reply)
+                                   { result = std::move(reply); });
+        QTest::qWaitFor([&result]()
+                        { return result.has_value(); }, 5000);
+        return result;
+    };
+
+    // A server that never starts answering fails long before the overall budget
+    mock.options().latency = std::chrono::milliseconds(2000);
+    QElapsedTimer elapsed;
+    elapsed.start();
+    auto result = stream();
+    QVERIFY(result && !result->has_value());
+    QCOMPARE(result->error().code, llm::e_error_code::first_byte_timeout);
+    QVERIFY(elapsed.elapsed() < 2000);
+
+    // An answer that stalls halfway
+    mock.options().latency = std::chrono::milliseconds(0);
+    mock.options().chunk_interval = std::chrono::milliseconds(1000);
+    result = stream();
+    QVERIFY(result && !result->has_value());
+    QCOMPARE(result->error().code, llm::e_error_code::idle_timeout);
+
+    // A slow but steady answer may take several times longer than any single deadline
+    const auto answer = mock.options().answer;
+    mock.options().answer = QStringList(20, QStringLiteral("word")).join(QLatin1Char(' '));
+    mock.options().chunk_interval = std::chrono::milliseconds(150);
+    elapsed.restart();
+    result = stream();
+    QVERIFY(result && result->has_value());
+    QCOMPARE(result->value(), mock.options().answer);
+    QVERIFY(elapsed.elapsed() >= 5 * config.idle_timeout_ms);
+    mock.options().answer = answer;
+
+    // Only the overall budget bounds an answer sent in one piece
+    mock.options().latency = std::chrono::milliseconds(600);
+    QVERIFY(client.send_message(QStringLiteral("test query")).has_value());
+    config.timeout_ms = 300;
+    QVERIFY(client.reconfigure(config));
+    result = client.send_message(QStringLiteral("test query"));
+    QVERIFY(!result->has_value());
+    QCOMPARE(result->error().code, llm::e_error_code::timeout);
+
+    // An endpoint that never completes the handshake: a listener that does not
+    // accept, whose backlog is already full, so the kernel drops further SYNs
+    QTcpServer black_hole;
+    black_hole.setListenBacklogSize(0);
+    black_hole.setMaxPendingConnections(0);
+    QVERIFY(black_hole.listen(QHostAddress::LocalHost));
+    QTcpSocket queued;
+    QTcpSocket dropped;
+    queued.connectToHost(QHostAddress::LocalHost, black_hole.serverPort());
+    dropped.connectToHost(QHostAddress::LocalHost, black_hole.serverPort());
+    QTest::qWait(100);
+
+    auto unreachable = create_test_config();
+    unreachable.base_url = QStringLiteral("http://127.0.0.1:%1").arg(black_hole.serverPort());
+    unreachable.timeout_ms = 10000;
+    unreachable.connect_timeout_ms = 300;
+    unreachable.first_byte_timeout_ms = 3000;
+    llm::c_client unconnected(unreachable);
+    elapsed.restart();
+    result = unconnected.send_message(QStringLiteral("test query"));
+    QVERIFY(!result->has_value());
+    QCOMPARE(result->error().code, llm::e_error_code::connect_timeout);
+    QVERIFY(elapsed.elapsed() < 3000);
+}
+
+void c_test_llm_client::test_local_provider()
+{
+    c_mock_provider mock;
+    QVERIFY(mock.listen());
+
+    // No key needed, and none sent
+    llm::s_config config;
+    config.provider = llm::e_provider::Local;
+    config.model = QStringLiteral("llama3.2");
+    config.base_url = mock.base_url();
+    llm::c_client client(config);
+    QVERIFY(!client.build_request().hasRawHeader("Authorization"));
+    QVERIFY(!client.local_socket());
+
+    auto result = client.send_message(QStringLiteral("test query"));
+    QVERIFY(result.has_value());
+    QCOMPARE(result.value(), mock.options().answer);
+
+    // The same server behind a Unix domain socket
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(mock.listen_local(dir.filePath(QStringLiteral("llm.sock"))));
+    config.base_url = mock.local_url();
+    llm::c_client local_client(config);
+    QCOMPARE(local_client.local_socket(), dir.filePath(QStringLiteral("llm.sock")));
+    QCOMPARE(local_client.get_endpoint(), QStringLiteral("http://localhost/v1/chat/completions"));
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
+    result = local_client.send_message(QStringLiteral("test query"));
+    QVERIFY(result.has_value());
+    QCOMPARE(result.value(), mock.options().answer);
+    QCOMPARE(mock.requests(), 2);
+#else
+    // Older Qt cannot reach the socket; the request fails at once instead of going to localhost:80
+    result = local_client.send_message(QStringLiteral("test query"));
+    QVERIFY(!result.has_value());
+    QCOMPARE(result.error().code, llm::e_error_code::network_error);
+    QCOMPARE(mock.requests(), 1);
+#endif
+}
+
+void c_test_llm_client::test_reconfigure()
+{
+    auto config = create_test_config();
+    llm::c_client client(config);
+
+    // Limits change in place and reach the next payload
+    config.max_tokens = 42;
+    config.timeout_ms = 5000;
+    QVERIFY(client.reconfigure(config));
+    QCOMPARE(QJsonDocument::fromJson(client.build_payload(QStringLiteral("test query"))).object()[QStringLiteral("max_tokens")].toInt(), 42);
+
+    // Anything that changes who answers needs a new client
+    auto other_model = config;
+    other_model.model = QStringLiteral("gpt-4o");
+    QVERIFY(!client.reconfigure(other_model));
+    auto other_key = config;
+    other_key.apiKey = QStringLiteral("other-key");
+    QVERIFY(!client.reconfigure(other_key));
+    QCOMPARE(QJsonDocument::fromJson(client.build_payload(QStringLiteral("test query"))).object()[QStringLiteral("model")].toString(), config.model);
+}
+
+void c_test_llm_client::test_follow_up_payload()
+{
+    const QList<llm::s_message> history{ { .role = QStringLiteral("user"), .content = QStringLiteral("weather in Paris?") },
+                                         { .role = QStringLiteral("assistant"), .content = QStringLiteral("20 degrees") } };
+    const auto prompt = QStringLiteral("and in Fahrenheit?");
+    auto config = create_test_config();
+
+    // Earlier turns go first, in the same form they were sent in
+    llm::c_client openai(config);
+    const auto messages = QJsonDocument::fromJson(openai.build_payload(history, prompt)).object()[QStringLiteral("messages")].toArray();
+    const auto first = QJsonDocument::fromJson(openai.build_payload(history.first().content)).object()[QStringLiteral("messages")].toArray();
+    QCOMPARE(messages.size(), 3);
+    QCOMPARE(messages[0], first[0]);
+    QCOMPARE(messages[1].toObject()[QStringLiteral("role")].toString(), QStringLiteral("assistant"));
+    QVERIFY(messages[2].toObject()[QStringLiteral("content")].toString().startsWith(prompt));
+
+    // Anthropic caches the prefix up to each of the two last questions, once it is
+    // long enough to be cached at all
+    config.provider = llm::e_provider::Anthropic;
+    llm::c_client anthropic(config);
+    const auto blocks = QJsonDocument::fromJson(anthropic.build_payload(history, prompt)).object()[QStringLiteral("messages")].toArray();
+    for (const auto &block : blocks)
+    {
+        QVERIFY(block.toObject()[QStringLiteral("content")].isString());
+    }
+
+    const QList<llm::s_message> long_history{ { .role = QStringLiteral("user"), .content = QString(5000, QLatin1Char('q')) },
+                                              { .role = QStringLiteral("assistant"), .content = QString(5000, QLatin1Char('a')) } };
+    const auto long_blocks = QJsonDocument::fromJson(anthropic.build_payload(long_history, prompt)).object()[QStringLiteral("messages")].toArray();
+    for (const auto index : { 0, 2 })
+    {
+        const auto block = long_blocks[index].toObject()[QStringLiteral("content")].toArray()[0].toObject();
+        QCOMPARE(block[QStringLiteral("cache_control")].toObject()[QStringLiteral("type")].toString(), QStringLiteral("ephemeral"));
+    }
+    QVERIFY(long_blocks[1].toObject()[QStringLiteral("content")].isString());
+
+    // A lone question keeps the prebuilt skeleton
+    QCOMPARE(anthropic.build_payload({}, prompt), anthropic.build_payload(prompt));
+
+    // Gemini names the assistant "model"
+    config.provider = llm::e_provider::Gemini;
+    llm::c_client gemini(config);
+    const auto contents = QJsonDocument::fromJson(gemini.build_payload(history, prompt)).object()[QStringLiteral("contents")].toArray();
+    QCOMPARE(contents.size(), 3);
+    QCOMPARE(contents[1].toObject()[QStringLiteral("role")].toString(), QStringLiteral("model"));
 }
 
 void c_test_llm_client::test_provider_endpoints()
@@ -110,9 +411,458 @@ void c_test_llm_client::test_request_building()
     QVERIFY(!config.apiKey.isEmpty());
     QVERIFY(!config.model.isEmpty());
     QVERIFY(config.timeout_ms > 0);
+
+    // The prebuilt skeletons splice in the prompt exactly as a DOM-built payload would hold it
+    const auto prompt = QStringLiteral("say \"hi\"\tto\nme \\ café 😀");
+    for (const auto provider : llm::all_providers)
+    {
+        config.provider = provider;
+        llm::c_client client(config);
+        for (const bool stream : { false, true })
+        {
+            const auto json = QJsonDocument::fromJson(client.build_payload(prompt, stream)).object();
+            QVERIFY(!json.isEmpty());
+
+            const auto &traits = llm::provider_traits(provider);
+            QString content;
+            if (traits.layout == llm::e_payload_layout::chat_messages)
+            {
+                content = json[QStringLiteral("messages")].toArray()[0].toObject()[QStringLiteral("content")].toString();
+                QCOMPARE(json[QStringLiteral("max_tokens")].toInt(), 200);
+            }
+            else
+            {
+                content = json[QStringLiteral("contents")].toArray()[0].toObject()[QStringLiteral("parts")].toArray()[0].toObject()[QStringLiteral("text")].toString();
+            }
+            QVERIFY(content.startsWith(prompt + QLatin1Char('\n')));
+            QCOMPARE(json[QStringLiteral("stream")].toBool(), stream && traits.stream_flag);
+
+            const auto request = client.build_request(stream);
+            QVERIFY(request.rawHeader(traits.auth_header.toByteArray()).endsWith(config.apiKey.toUtf8()));
+            QCOMPARE(request.url().toString(), client.get_endpoint(stream));
+        }
+    }
+}
+
+void c_test_llm_client::test_shared_connection_pool()
+{
+    auto pool = std::make_shared<llm::c_connection_pool>();
+    QVERIFY(pool->manager() != nullptr);
+
+    auto first_client = std::make_unique<llm::c_client>(create_test_config(), pool);
+    auto second_client = std::make_unique<llm::c_client>(create_test_config(), pool);
+
+    // Both clients borrow the pool, so it outlives neither of them
+    QCOMPARE(pool.use_count(), 3);
+    first_client.reset();
+    second_client.reset();
+    QCOMPARE(pool.use_count(), 1);
+
+    pool->set_keep_alive(std::chrono::seconds(45));
+    QNetworkRequest request;
+    pool->prepare(request);
+    QCOMPARE(request.attribute(QNetworkRequest::Http2AllowedAttribute).toBool(), true);
+    QCOMPARE(request.attribute(QNetworkRequest::ConnectionCacheExpiryTimeoutSecondsAttribute).toInt(), 45);
+    QVERIFY(!request.sslConfiguration().testSslOption(QSsl::SslOptionDisableSessionPersistence));
+}
+
+void c_test_llm_client::test_async_cancellation()
+{
+    auto client = std::make_unique<llm::c_client>(create_test_config());
+
+    bool callback_invoked = false;
+    auto handle = client->send_message_async(QStringLiteral("test query"), [&callback_invoked](llm::t_result)
+                                             { callback_invoked = true; });
+    QVERIFY(handle.is_active());
+
+    handle.cancel();
+    QVERIFY(!handle.is_active());
+
+    // Give the aborted reply a chance to deliver its finished signal
+    QTest::qWait(50);
+    QVERIFY(!callback_invoked);
+}
+
+void c_test_llm_client::test_sse_parser()
+{
+    llm::c_sse_parser parser;
+
+    // An event split across reads is only emitted once it is terminated
+    auto events = parser.feed("event: content_block_delta\r\ndata: {\"a\":");
+    QVERIFY(events.isEmpty());
+    events = parser.feed("1}\r\n\r\n: keep-alive\n\ndata: first\ndata: second\n\n");
+
+    QCOMPARE(events.size(), 2);
+    QCOMPARE(events[0].event, QByteArray("content_block_delta"));
+    QCOMPARE(events[0].data, QByteArray("{\"a\":1}"));
+    QVERIFY(events[1].event.isEmpty());
+    QCOMPARE(events[1].data, QByteArray("first\nsecond"));
+}
+
+void c_test_llm_client::test_stream_event_parsing()
+{
+    auto openai_config = create_test_config();
+    llm::c_client openai_client(openai_config);
+    auto chunk = openai_client.parse_stream_event({ .event = {}, .data = R"({"choices":[{"delta":{"content":"Hel"}}]})" });
+    QCOMPARE(chunk.value(), QStringLiteral("Hel"));
+    QCOMPARE(openai_client.parse_stream_event({ .event = {}, .data = "[DONE]" }).value(), QString());
+
+    auto anthropic_config = create_test_config();
+    anthropic_config.provider = llm::e_provider::Anthropic;
+    llm::c_client anthropic_client(anthropic_config);
+    chunk = anthropic_client.parse_stream_event({ .event = "content_block_delta",
+                                                  .data = R"({"type":"content_block_delta","index":0,"delta":{"type":"text_delta","text":"lo"}})" });
+    QCOMPARE(chunk.value(), QStringLiteral("lo"));
+    chunk = anthropic_client.parse_stream_event({ .event = "ping", .data = R"({"type":"ping"})" });
+    QCOMPARE(chunk.value(), QString());
+
+    auto gemini_config = create_test_config();
+    gemini_config.provider = llm::e_provider::Gemini;
+    llm::c_client gemini_client(gemini_config);
+    chunk = gemini_client.parse_stream_event({ .event = {}, .data = R"({"candidates":[{"content":{"parts":[{"text":"!"}]}}]})" });
+    QCOMPARE(chunk.value(), QStringLiteral("!"));
+
+    chunk = openai_client.parse_stream_event({ .event = {}, .data = R"({"error":{"message":"overloaded"}})" });
+    QVERIFY(!chunk.has_value());
+    QCOMPARE(chunk.error().message, QStringLiteral("overloaded"));
+}
+
+void c_test_llm_client::test_json_extraction()
+{
+    // Members and elements off the path are skipped, including nested containers and strings with brackets
+    const QByteArray body = R"({"id":"x","usage":{"tokens":[1,2,{"a":"]}"}]},"choices":[{"logprobs":null},{"message":{"role":"assistant","content":"second"}}],"done":true})";
+    QCOMPARE(llm::extract_json_string(body, "choices.1.message.content"), std::optional(QStringLiteral("second")));
+    QCOMPARE(llm::extract_json_string(body, "id"), std::optional(QStringLiteral("x")));
+
+    QVERIFY(!llm::extract_json_string(body, "choices.2.message.content").has_value());
+    QVERIFY(!llm::extract_json_string(body, "choices.0.message").has_value());
+    QVERIFY(!llm::extract_json_string(body, "done").has_value());
+    QVERIFY(!llm::extract_json_string("[]", "id").has_value());
+    QVERIFY(!llm::extract_json_string(R"({"id": "unterminated)", "id").has_value());
+
+    // Escapes, including a surrogate pair, decode like QJsonDocument does
+    const QByteArray escaped = R"({"text": "line\n\"quoted\" \\ \u00e9 \ud83d\ude00 café"})";
+    const auto expected = QJsonDocument::fromJson(escaped).object()[QStringLiteral("text")].toString();
+    QCOMPARE(llm::extract_json_string(escaped, "text"), std::optional(expected));
+    QVERIFY(!llm::decode_json_string(R"(bad \q escape)").has_value());
+
+    // The client takes the fast path for answers and still reports errors from the DOM
+    llm::c_client client(create_test_config());
+    auto result = client.parse_response(R"({"choices":[{"message":{"content":"hi"}}]})");
+    QVERIFY(result.has_value());
+    QCOMPARE(*result, QStringLiteral("hi"));
+    result = client.parse_response(R"({"error":{"message":"bad key"}})");
+    QVERIFY(!result.has_value());
+    QCOMPARE(result.error().message, QStringLiteral("bad key"));
+
+    // choices[0] has no message: the DOM path explains what is missing
+    result = client.parse_response(body);
+    QVERIFY(!result.has_value());
+    QCOMPARE(result.error().message, QStringLiteral("Empty response content"));
+}
+
+void c_test_llm_client::test_latency_window()
+{
+    using namespace std::chrono_literals;
+    llm::c_latency_window window(100);
+    QCOMPARE(window.percentile(0.95), 0ms);
+
+    for (int i = 1; i <= 100; ++i)
+    {
+        window.add(std::chrono::milliseconds(i * 10));
+    }
+    QCOMPARE(window.percentile(0.5), 500ms);
+    QCOMPARE(window.percentile(0.95), 950ms);
+    QCOMPARE(window.percentile(1.0), 1000ms);
+
+    // New samples replace the oldest ones
+    for (int i = 0; i < 100; ++i)
+    {
+        window.add(20ms);
+    }
+    QCOMPARE(window.size(), std::size_t(100));
+    QCOMPARE(window.percentile(0.99), 20ms);
+}
+
+void c_test_llm_client::test_circuit_breaker()
+{
+    using namespace std::chrono_literals;
+    llm::c_circuit_breaker breaker(2, 10s);
+    auto now = llm::c_circuit_breaker::t_clock::now();
+
+    QVERIFY(breaker.allow_request(now));
+    breaker.record_failure(now);
+    QCOMPARE(breaker.state(), llm::e_breaker_state::closed);
+    breaker.record_failure(now);
+    QCOMPARE(breaker.state(), llm::e_breaker_state::open);
+    QVERIFY(!breaker.allow_request(now + 5s));
+
+    // After the cooldown exactly one probe goes through
+    QVERIFY(breaker.allow_request(now + 11s));
+    QCOMPARE(breaker.state(), llm::e_breaker_state::half_open);
+    QVERIFY(!breaker.allow_request(now + 11s));
+
+    // A failed probe re-opens immediately, a successful one closes
+    breaker.record_failure(now + 12s);
+    QCOMPARE(breaker.state(), llm::e_breaker_state::open);
+    QVERIFY(breaker.allow_request(now + 23s));
+    breaker.record_success();
+    QCOMPARE(breaker.state(), llm::e_breaker_state::closed);
+    QVERIFY(breaker.allow_request(now + 23s));
+
+    // A cancelled probe hands the slot to the next request instead of blocking the provider
+    breaker.record_failure(now + 24s);
+    breaker.record_failure(now + 24s);
+    QVERIFY(breaker.allow_request(now + 35s));
+    QVERIFY(!breaker.allow_request(now + 35s));
+    breaker.release_probe();
+    QCOMPARE(breaker.state(), llm::e_breaker_state::half_open);
+    QVERIFY(breaker.allow_request(now + 36s));
+    QVERIFY(!breaker.allow_request(now + 36s));
+
+    // Only the request a half-open breaker let through owns the probe
+    llm::c_provider_chain chain([]()
+                                { return std::shared_ptr<llm::c_connection_pool>(); });
+    chain.apply({ create_test_config() }, 1, 0s, std::nullopt);
+    QCOMPARE(chain.next_available(), std::optional<std::size_t>(0));
+    QVERIFY(!chain.probing(0));
+    chain.breaker(0).record_failure();
+    QCOMPARE(chain.next_available(), std::optional<std::size_t>(0));
+    QVERIFY(chain.probing(0));
+    QVERIFY(!chain.probing(1));
+}
+
+void c_test_llm_client::test_auth_errors()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    c_mock_provider rejecting({ .error_status = 401 });
+    c_mock_provider fallback;
+    QVERIFY(rejecting.listen());
+    QVERIFY(fallback.listen());
+
+    llm::s_settings settings;
+    settings.primary = create_test_config();
+    settings.primary.base_url = rejecting.base_url();
+    settings.fallbacks = { create_test_config() };
+    settings.fallbacks.front().base_url = fallback.base_url();
+    settings.failure_threshold = 1;
+    settings.streaming = false;
+    settings.disk_cache_bytes = 0;
+    llm::c_query_engine engine(this, QStringLiteral("test"), false);
+    engine.apply(settings);
+
+    // A rejected key is the user's to fix: the fallback is not asked and the breaker stays closed
+    for (const auto &prompt : { QStringLiteral("first question"), QStringLiteral("second question") })
+    {
+        std::optional<llm::s_error> error;
+        engine.ask(prompt, { .answer = [](const QString &, llm::c_query_engine::e_answer)
+                             { return true; },
+                             .fail = [&error](const llm::s_error &failure)
+                             {
+                                 error = failure;
+                                 return true;
+                             } });
+        QVERIFY(QTest::qWaitFor([&error]()
+                                { return error.has_value(); }, 5000));
+        QCOMPARE(error->code, llm::e_error_code::invalid_api_key);
+    }
+    QCOMPARE(rejecting.requests(), 2);
+    QCOMPARE(fallback.requests(), 0);
+}
+
+void c_test_llm_client::test_cascade()
+{
+    using e_answer = llm::c_query_engine::e_answer;
+
+    QStandardPaths::setTestModeEnabled(true);
+    c_mock_provider main({ .latency = std::chrono::milliseconds(600), .answer = QStringLiteral("The considered main answer.") });
+    c_mock_provider fast({ .answer = QStringLiteral("A quick draft.") });
+    QVERIFY(main.listen());
+    QVERIFY(fast.listen());
+
+    llm::s_settings settings;
+    settings.primary = create_test_config();
+    settings.primary.base_url = main.base_url();
+    settings.draft = create_test_config();
+    settings.draft->model = QStringLiteral("draft-model");
+    settings.draft->base_url = fast.base_url();
+    settings.disk_cache_bytes = 0;
+    // The runner's engine: it can update the answer it shows
+    llm::c_query_engine engine(this, QStringLiteral("test"), true);
+    engine.apply(settings);
+
+    // What one KRunner match shows, update after update
+    struct s_shown
+    {
+        QString text;
+        e_answer kind;
+    };
+    QList<s_shown> shown;
+    bool failed = false;
+    const auto waiter = [&shown, &failed]()
+    {
+        return llm::c_query_engine::s_waiter{ .answer = [&shown](const QString &text, e_answer kind)
+                                              {
+                                                  shown.append({ text, kind });
+                                                  return true;
+                                              },
+                                              .fail = [&failed](const llm::s_error &)
+                                              {
+                                                  failed = true;
+                                                  return true;
+                                              } };
+    };
+    const auto completed = [&shown]()
+    {
+        return !shown.isEmpty() && shown.back().kind == e_answer::complete;
+    };
+    const auto drafted = [&shown]()
+    {
+        return !shown.isEmpty() && shown.front().kind == e_answer::draft;
+    };
+
+    // The draft shows first and is upgraded in place; the main answer's chunks wait behind it
+    engine.ask(QStringLiteral("first question"), waiter());
+    QVERIFY(QTest::qWaitFor(completed, 5000));
+    QCOMPARE(shown.size(), 2);
+    QCOMPARE(shown.front().kind, e_answer::draft);
+    QCOMPARE(shown.front().text, fast.options().answer);
+    QCOMPARE(shown.back().text, main.options().answer);
+    QCOMPARE(engine.stats().drafts, 1);
+
+    // A draft beats an error, but is not cached as the answer
+    shown.clear();
+    main.options().error_status = 400;
+    engine.ask(QStringLiteral("second question"), waiter());
+    QVERIFY(QTest::qWaitFor(completed, 5000));
+    QVERIFY(!failed);
+    QCOMPARE(shown.size(), 2);
+    QCOMPARE(shown.back().text, fast.options().answer);
+    QVERIFY(!engine.cached_response(engine.cache_key(QStringLiteral("second question"))).has_value());
+    main.options().error_status = 0;
+
+    // Taking the draft cancels the upgrade (SkipUpgradeWhenUsed)
+    shown.clear();
+    const auto cancelled = engine.stats().cancelled;
+    engine.ask(QStringLiteral("third question"), waiter());
+    QVERIFY(QTest::qWaitFor(drafted, 5000));
+    engine.take_answer(QStringLiteral("third question"), fast.options().answer);
+    QTest::qWait(1000);
+    QCOMPARE(shown.size(), 1);
+    QCOMPARE(engine.stats().cancelled, cancelled + 1);
+
+    // A request sent again after reconfiguring keeps its draft instead of asking for another
+    shown.clear();
+    const auto main_requests = main.requests();
+    engine.ask(QStringLiteral("fourth question"), waiter());
+    QVERIFY(QTest::qWaitFor(drafted, 5000));
+    const auto fast_requests = fast.requests();
+    settings.primary.model = QStringLiteral("gpt-4o");
+    engine.apply(settings);
+    QVERIFY(QTest::qWaitFor(completed, 5000));
+    QCOMPARE(shown.size(), 2);
+    QCOMPARE(shown.back().text, main.options().answer);
+    QCOMPARE(fast.requests(), fast_requests);
+    QCOMPARE(main.requests(), main_requests + 2);
+    QVERIFY(!failed);
+}
+
+void c_test_llm_client::test_latency_histogram()
+{
+    using namespace std::chrono_literals;
+
+    // Buckets are contiguous and every value lands in the bucket that bounds it
+    for (std::uint64_t value : { 0ULL, 63ULL, 64ULL, 65ULL, 127ULL, 128ULL, 1000ULL, 123456789ULL })
+    {
+        const auto index = llm::c_latency_histogram::bucket_index(value);
+        QVERIFY(llm::c_latency_histogram::bucket_upper_bound(index) >= value);
+        if (index > 0)
+        {
+            QVERIFY(llm::c_latency_histogram::bucket_upper_bound(index - 1) < value);
+        }
+    }
+
+    llm::c_latency_histogram histogram;
+    QCOMPARE(histogram.percentile(0.5), 0us);
+    for (int i = 1; i <= 100; ++i)
+    {
+        histogram.record(std::chrono::milliseconds(i));
+    }
+    QCOMPARE(histogram.count(), std::uint64_t(100));
+
+    // Within the ~3% bucket precision of the exact answers
+    const auto p50 = histogram.percentile(0.5);
+    const auto p99 = histogram.percentile(0.99);
+    QVERIFY(p50 >= 50ms && p50 <= 52ms);
+    QVERIFY(p99 >= 99ms && p99 <= 103ms);
+
+    auto &series = llm::c_latency_registry::instance().series(QStringLiteral("test/model"));
+    QCOMPARE(&series, &llm::c_latency_registry::instance().series(QStringLiteral("test/model")));
+    series.record(llm::e_phase::parse, 2ms);
+    QVERIFY(llm::c_latency_registry::instance().report().contains(QStringLiteral("test/model parse: n=1")));
+}
+
+void c_test_llm_client::test_rate_limiter()
+{
+    using namespace std::chrono_literals;
+    const auto start = llm::c_rate_limiter::t_clock::now();
+
+    // 60 requests per minute: a full bucket absorbs a burst, then one request per second
+    llm::c_rate_limiter limiter(60, 0);
+    for (int i = 0; i < 60; ++i)
+    {
+        QCOMPARE(limiter.reserve(10, start), 0ms);
+    }
+    QCOMPARE(limiter.reserve(10, start), 1000ms);
+    QCOMPARE(limiter.reserve(10, start + 2s), 0ms);
+
+    // An explicit block outweighs spare capacity
+    limiter.block_until(start + 5s);
+    QCOMPARE(limiter.reserve(10, start + 3s), 2000ms);
+
+    // Tokens per minute limit large requests independently
+    llm::c_rate_limiter tokens(0, 600);
+    QCOMPARE(tokens.reserve(600, start), 0ms);
+    QCOMPARE(tokens.reserve(300, start), 30000ms);
+
+    // Re-applying the same limits, as every client on the account does, refills nothing
+    tokens.set_limits(0, 600);
+    QCOMPARE(tokens.reserve(300, start), 60000ms);
+
+    QVERIFY(llm::c_rate_limiter::shared(QStringLiteral("a")) == llm::c_rate_limiter::shared(QStringLiteral("a")));
+}
+
+void c_test_llm_client::test_rate_limit_headers()
+{
+    using namespace std::chrono_literals;
+
+    QCOMPARE(llm::parse_duration("20ms"), std::optional(20ms));
+    QCOMPARE(llm::parse_duration("1.5s"), std::optional(1500ms));
+    QCOMPARE(llm::parse_duration("6m0s"), std::optional(360000ms));
+    QVERIFY(!llm::parse_duration("soon").has_value());
+
+    const auto now = QDateTime::currentDateTimeUtc();
+    auto hint = llm::parse_rate_limit_headers({ { "Retry-After", "2" } }, now);
+    QCOMPARE(hint.retry_after, std::optional(2000ms));
+    QVERIFY(!hint.quota_reset.has_value());
+
+    hint = llm::parse_rate_limit_headers({ { "retry-after-ms", "150" }, { "Retry-After", "2" } }, now);
+    QCOMPARE(hint.retry_after, std::optional(150ms));
+
+    // A quota that still has room does not force a wait
+    hint = llm::parse_rate_limit_headers({ { "x-ratelimit-remaining-tokens", "12" }, { "x-ratelimit-reset-tokens", "7s" } }, now);
+    QVERIFY(!hint.quota_reset.has_value());
+
+    hint = llm::parse_rate_limit_headers({ { "x-ratelimit-remaining-requests", "0" }, { "x-ratelimit-reset-requests", "1m30s" } }, now);
+    QCOMPARE(hint.quota_reset, std::optional(90000ms));
+
+    const auto reset = now.addSecs(10).toString(Qt::ISODate).toLatin1();
+    hint = llm::parse_rate_limit_headers({ { "anthropic-ratelimit-tokens-remaining", "0" }, { "anthropic-ratelimit-tokens-reset", reset } }, now);
+    QVERIFY(hint.quota_reset.has_value());
+    QVERIFY(*hint.quota_reset > 9s && *hint.quota_reset <= 10s);
 }
 
-void c_test_llm_client::cleanup_test_case()
+void c_test_llm_client::cleanupTestCase()
 {
     // Cleanup
 }
@@ -0,0 +1,200 @@
+#include "../src/llmdaemon.hpp"
+#include "mockprovider.hpp"
+#include <KConfigGroup>
+#include <KSharedConfig>
+#include <QClipboard>
+#include <QDBusConnection>
+#include <QDBusPendingReply>
+#include <QGuiApplication>
+#include <QStandardPaths>
+#include <QString>
+#include <QTest>
+
+#include <chrono>
+#include <memory>
+
+// Talks to the daemon over the session bus the way KRunner does, from
+// connections of its own so every client has its own sender
+class c_test_llm_daemon : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void test_match_and_run();
+    void test_release_and_teardown();
+    void test_reattach();
+    void test_expire();
+    void cleanupTestCase();
+
+private:
+    [[nodiscard]] auto client(const QString &name) -> QDBusConnection;
+    [[nodiscard]] auto call(const QDBusConnection &connection, const QString &method, const QVariantList &arguments) -> QDBusPendingCall;
+    [[nodiscard]] static auto matches(QDBusPendingCall &pending) -> llm::t_remote_matches;
+
+    c_mock_provider m_mock{ { .latency = std::chrono::milliseconds(300) } };
+    std::unique_ptr<c_llm_daemon> m_daemon;
+    QString m_service;
+};
+
+void c_test_llm_daemon::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    if (!QDBusConnection::sessionBus().isConnected())
+    {
+        QSKIP("No session bus to serve org.kde.krunner1 on");
+    }
+    QVERIFY(m_mock.listen());
+
+    // A short fixed debounce and no speculation keep the timing predictable
+    auto config = KSharedConfig::openConfig(QStringLiteral("krunnerllmrc"));
+    auto group = config->group(QStringLiteral("General"));
+    group.writeEntry(QStringLiteral("TriggerWord"), QStringLiteral("llm"));
+    group.writeEntry(QStringLiteral("Provider"), QStringLiteral("OpenAI"));
+    group.writeEntry(QStringLiteral("ApiKey"), QStringLiteral("daemon-key"));
+    group.writeEntry(QStringLiteral("Model"), QStringLiteral("gpt-4"));
+    group.writeEntry(QStringLiteral("BaseUrl"), m_mock.base_url());
+    group.writeEntry(QStringLiteral("AdaptiveDebounce"), false);
+    group.writeEntry(QStringLiteral("DebounceDelay"), 50);
+    group.writeEntry(QStringLiteral("SpeculativePerMinute"), 0);
+    group.writeEntry(QStringLiteral("DiskCacheSize"), 0);
+    config->sync();
+
+    llm::register_dbus_types();
+    m_daemon = std::make_unique<c_llm_daemon>();
+    auto bus = QDBusConnection::sessionBus();
+    QVERIFY(bus.registerObject(QStringLiteral("/runner"), m_daemon.get(), QDBusConnection::ExportAllSlots));
+    m_service = bus.baseService();
+}
+
+void c_test_llm_daemon::test_match_and_run()
+{
+    auto krunner = client(QStringLiteral("match-and-run"));
+    const auto requests = m_mock.requests();
+
+    auto pending = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm capital of peru") });
+    const auto answered = matches(pending);
+    QCOMPARE(answered.size(), 1);
+    QCOMPARE(answered.front().text, m_mock.options().answer);
+    QVERIFY(answered.front().id.startsWith(QLatin1StringView("answer-")));
+    QCOMPARE(m_mock.requests(), requests + 1);
+
+    // Asked again, the answer comes from the cache without holding the call
+    auto again = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm capital of peru") });
+    QCOMPARE(matches(again).value(0).text, m_mock.options().answer);
+    QCOMPARE(m_mock.requests(), requests + 1);
+
+    auto run = call(krunner, QStringLiteral("Run"), { answered.front().id, QStringLiteral("copy") });
+    QVERIFY(QTest::qWaitFor([&run]()
+                            { return run.isFinished(); }, 5000));
+    QVERIFY(!run.isError());
+    QCOMPARE(QGuiApplication::clipboard()->text(), m_mock.options().answer);
+}
+
+void c_test_llm_daemon::test_release_and_teardown()
+{
+    auto krunner = client(QStringLiteral("release"));
+    m_mock.options().latency = std::chrono::milliseconds(1000);
+
+    // A newer question from the same client answers the held one with nothing
+    auto first = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm first question on the wire") });
+    QTest::qWait(200);
+    auto second = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm second question on the wire") });
+    QVERIFY(QTest::qWaitFor([&first]()
+                            { return first.isFinished(); }, 500));
+    QVERIFY(matches(first).isEmpty());
+    QCOMPARE(matches(second).size(), 1);
+
+    // Another client's question is not released by it
+    auto other = client(QStringLiteral("release-other"));
+    auto mine = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm a question of my own") });
+    auto theirs = call(other, QStringLiteral("Match"), { QStringLiteral("llm a question of their own") });
+    QCOMPARE(matches(mine).size(), 1);
+    QCOMPARE(matches(theirs).size(), 1);
+
+    // Closing KRunner answers whatever it still waits for
+    auto held = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm asked right before closing") });
+    QTest::qWait(200);
+    auto teardown = call(krunner, QStringLiteral("Teardown"), {});
+    QVERIFY(QTest::qWaitFor([&held]()
+                            { return held.isFinished(); }, 500));
+    QVERIFY(matches(held).isEmpty());
+    m_mock.options().latency = std::chrono::milliseconds(300);
+}
+
+void c_test_llm_daemon::test_reattach()
+{
+    auto krunner = client(QStringLiteral("reattach"));
+    m_mock.options().latency = std::chrono::milliseconds(600);
+    const auto requests = m_mock.requests();
+
+    // The same question again takes over the request on the wire instead of sending another
+    auto first = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm asked twice in a row") });
+    QTest::qWait(200);
+    auto second = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm asked twice in a row") });
+    QVERIFY(matches(first).isEmpty());
+    const auto answered = matches(second);
+    QCOMPARE(answered.size(), 1);
+    QCOMPARE(answered.front().text, m_mock.options().answer);
+    QCOMPARE(m_mock.requests(), requests + 1);
+    m_mock.options().latency = std::chrono::milliseconds(300);
+}
+
+void c_test_llm_daemon::test_expire()
+{
+    auto krunner = client(QStringLiteral("expire"));
+    m_mock.options().latency = std::chrono::milliseconds(800);
+    m_daemon->set_reply_wait(std::chrono::milliseconds(300));
+    const auto requests = m_mock.requests();
+
+    // The held call is answered before the client's D-Bus timeout, the request keeps running
+    auto pending = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm a slow question") });
+    const auto expired = matches(pending);
+    QCOMPARE(expired.size(), 1);
+    QCOMPARE(expired.front().id, QStringLiteral("status"));
+    QCOMPARE(expired.front().icon_name, QStringLiteral("view-refresh"));
+
+    // Its answer lands in the cache for the next Match
+    QTest::qWait(1000);
+    auto again = call(krunner, QStringLiteral("Match"), { QStringLiteral("llm a slow question") });
+    QCOMPARE(matches(again).value(0).text, m_mock.options().answer);
+    QCOMPARE(m_mock.requests(), requests + 1);
+
+    m_daemon->set_reply_wait(std::chrono::seconds(20));
+    m_mock.options().latency = std::chrono::milliseconds(300);
+}
+
+void c_test_llm_daemon::cleanupTestCase()
+{
+    QDBusConnection::sessionBus().unregisterObject(QStringLiteral("/runner"));
+    m_daemon.reset();
+    auto config = KSharedConfig::openConfig(QStringLiteral("krunnerllmrc"));
+    config->group(QStringLiteral("General")).deleteGroup();
+    config->sync();
+}
+
+auto c_test_llm_daemon::client(const QString &name) -> QDBusConnection
+{
+    return QDBusConnection::connectToBus(QDBusConnection::SessionBus, name);
+}
+
+auto c_test_llm_daemon::call(const QDBusConnection &connection, const QString &method, const QVariantList &arguments) -> QDBusPendingCall
+{
+    auto message = QDBusMessage::createMethodCall(m_service, QStringLiteral("/runner"), QStringLiteral("org.kde.krunner1"), method);
+    message.setArguments(arguments);
+    return connection.asyncCall(message);
+}
+
+auto c_test_llm_daemon::matches(QDBusPendingCall &pending) -> llm::t_remote_matches
+{
+    if (!QTest::qWaitFor([&pending]()
+                         { return pending.isFinished(); }, 5000))
+    {
+        return {};
+    }
+    QDBusPendingReply<llm::t_remote_matches> reply = pending;
+    return reply.isValid() ? reply.value() : llm::t_remote_matches();
+}
+
+QTEST_MAIN(c_test_llm_daemon)
+#include "test_llmdaemon.moc"
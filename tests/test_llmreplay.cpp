@@ -0,0 +1,162 @@
+#include "../src/llmrunner.hpp"
+#include "mockprovider.hpp"
+#include <KConfigGroup>
+#include <KPluginMetaData>
+#include <KRunner/RunnerContext>
+#include <KSharedConfig>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QString>
+#include <QTest>
+
+#include <algorithm>
+#include <chrono>
+
+// Replays recorded keystroke timelines against an in-process runner talking
+// to the mock provider, and reports what the typing cost. Traces live in
+// tests/traces as "<milliseconds since start>\t<query>" lines.
+class c_test_llm_replay : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void test_replay_data();
+    void test_replay();
+
+private:
+    struct s_keystroke
+    {
+        std::chrono::milliseconds at;
+        QString query;
+    };
+
+    [[nodiscard]] static auto load_trace(const QString &path) -> QList<s_keystroke>;
+    [[nodiscard]] static auto has_answer(const KRunner::RunnerContext &context) -> bool;
+
+    c_mock_provider m_mock{ { .latency = std::chrono::milliseconds(150), .chunk_interval = std::chrono::milliseconds(20) } };
+};
+
+void c_test_llm_replay::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QVERIFY(m_mock.listen());
+
+    // A fixed debounce keeps runs comparable; the disk cache would leak answers between runs
+    auto config = KSharedConfig::openConfig(QStringLiteral("krunnerllmrc"));
+    auto group = config->group(QStringLiteral("General"));
+    group.writeEntry(QStringLiteral("TriggerWord"), QStringLiteral("llm"));
+    group.writeEntry(QStringLiteral("Provider"), QStringLiteral("OpenAI"));
+    group.writeEntry(QStringLiteral("ApiKey"), QStringLiteral("replay-key"));
+    group.writeEntry(QStringLiteral("Model"), QStringLiteral("gpt-4"));
+    group.writeEntry(QStringLiteral("BaseUrl"), m_mock.base_url());
+    group.writeEntry(QStringLiteral("AdaptiveDebounce"), false);
+    group.writeEntry(QStringLiteral("DebounceDelay"), 800);
+    group.writeEntry(QStringLiteral("DiskCacheSize"), 0);
+    config->sync();
+}
+
+void c_test_llm_replay::test_replay_data()
+{
+    QTest::addColumn<QString>("trace");
+
+    const QDir traces(QFINDTESTDATA("traces"));
+    for (const auto &name : traces.entryList({ QStringLiteral("*.trace") }, QDir::Files, QDir::Name))
+    {
+        QTest::newRow(qPrintable(name)) << traces.filePath(name);
+    }
+}
+
+void c_test_llm_replay::test_replay()
+{
+    QFETCH(QString, trace);
+    const auto keystrokes = load_trace(trace);
+    QVERIFY(!keystrokes.isEmpty());
+
+    c_llm_runner runner(nullptr, KPluginMetaData());
+    KRunner::RunnerContext context;
+
+    // Keystrokes are replayed in real time so the debounce timer sees real gaps
+    QElapsedTimer clock;
+    clock.start();
+    for (const auto &keystroke : keystrokes)
+    {
+        const auto wait = keystroke.at.count() - clock.elapsed();
+        if (wait > 0)
+        {
+            QTest::qWait(static_cast<int>(wait));
+        }
+        // A new query invalidates every copy of the previous one, like KRunner does
+        context.setQuery(keystroke.query);
+        runner.match(context);
+    }
+    const auto last_keystroke = clock.elapsed();
+
+    const bool answered = QTest::qWaitFor([&context]()
+                                          { return has_answer(context); }, 10000);
+    const auto answer_after = clock.elapsed() - last_keystroke;
+
+    // Let cancelled and late replies settle so they show up in the counters
+    QTest::qWait(300);
+
+    const auto &stats = runner.stats();
+    qInfo().noquote() << QStringLiteral("%1: keystrokes=%2 requests=%3 speculative=%4 cancelled=%5 cache_hits=%6 joined=%7 stale_contexts=%8 answer_after_last_keystroke=%9ms")
+                             .arg(QFileInfo(trace).baseName())
+                             .arg(stats.keystrokes)
+                             .arg(stats.dispatched)
+                             .arg(stats.speculative)
+                             .arg(stats.cancelled)
+                             .arg(stats.cache_hits)
+                             .arg(stats.joined)
+                             .arg(stats.stale_contexts)
+                             .arg(answered ? answer_after : -1);
+
+    QVERIFY(answered);
+    // Every trace ends in a question that has to be asked or found in the cache
+    QVERIFY(stats.dispatched + stats.cache_hits >= 1);
+}
+
+auto c_test_llm_replay::load_trace(const QString &path) -> QList<s_keystroke>
+{
+    QList<s_keystroke> keystrokes;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return keystrokes;
+    }
+
+    while (!file.atEnd())
+    {
+        auto line = QString::fromUtf8(file.readLine());
+        if (line.endsWith(QLatin1Char('\n')))
+        {
+            line.chop(1);
+        }
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+        {
+            continue;
+        }
+
+        const auto tab = line.indexOf(QLatin1Char('\t'));
+        if (tab <= 0)
+        {
+            continue;
+        }
+        keystrokes.append({ .at = std::chrono::milliseconds(line.left(tab).toLongLong()), .query = line.mid(tab + 1) });
+    }
+    return keystrokes;
+}
+
+auto c_test_llm_replay::has_answer(const KRunner::RunnerContext &context) -> bool
+{
+    const auto matches = context.matches();
+    return std::ranges::any_of(matches, [](const KRunner::QueryMatch &match)
+                               { return match.iconName() == QStringLiteral("dialog-information"); });
+}
+
+QTEST_GUILESS_MAIN(c_test_llm_replay)
+#include "test_llmreplay.moc"
@@ -1,3 +1,8 @@
+#include "../src/llmcadence.hpp"
+#include "../src/llmproviderchain.hpp"
+#include "../src/llmreachability.hpp"
+#include "../src/llmrouter.hpp"
+#include "../src/llmspeculation.hpp"
 #include "../src/llmrunner.hpp"
 #include <KConfigGroup>
 #include <KSharedConfig>
@@ -9,17 +14,21 @@ class c_test_llm_runner : public QObject
     Q_OBJECT
 
 private Q_SLOTS:
-    void init_test_case();
+    void initTestCase();
     void test_trigger_word_detection();
     void test_config_loading();
     void test_empty_query();
-    void cleanup_test_case();
+    void test_adaptive_debounce();
+    void test_offline_providers();
+    void test_speculative_dispatch();
+    void test_query_routing();
+    void cleanupTestCase();
 
 private:
     void setup_test_config();
 };
 
-void c_test_llm_runner::init_test_case()
+void c_test_llm_runner::initTestCase()
 {
     setup_test_config();
 }
@@ -65,6 +74,39 @@ void c_test_llm_runner::test_config_loading()
     QCOMPARE(provider, QStringLiteral("OpenAI"));
     QCOMPARE(api_key, QStringLiteral("test-key"));
     QCOMPARE(model, QStringLiteral("gpt-4"));
+
+    // The runner plugin and the D-Bus daemon read it the same way
+    const auto settings = llm::read_settings(config);
+    QCOMPARE(settings.trigger_word, QStringLiteral("llm"));
+    QCOMPARE(settings.primary.provider, llm::e_provider::OpenAI);
+    QCOMPARE(settings.primary.apiKey, QStringLiteral("test-key"));
+    QCOMPARE(settings.primary.max_tokens, 150);
+    QVERIFY(settings.fallbacks.empty());
+    QVERIFY(llm::is_configured(settings.primary));
+    QVERIFY(!settings.draft);
+
+    // A cascade draft model inherits what it does not set itself
+    auto cascade = config->group(QStringLiteral("Cascade"));
+    cascade.writeEntry(QStringLiteral("Enabled"), true);
+    cascade.writeEntry(QStringLiteral("ApiKey"), QStringLiteral("draft-key"));
+    const auto cascaded = llm::read_settings(config);
+    cascade.deleteGroup();
+    QVERIFY(cascaded.draft);
+    QCOMPARE(cascaded.draft->provider, llm::e_provider::Groq);
+    QCOMPARE(cascaded.draft->model, QStringLiteral("llama-3.1-8b-instant"));
+    QCOMPARE(cascaded.draft->max_tokens, 150);
+    QVERIFY(cascaded.skip_upgrade_when_used);
+
+    // A fallback on the same account shares the configured rate limits instead of lifting them
+    group.writeEntry(QStringLiteral("RequestsPerMinute"), 60);
+    auto fallback = config->group(QStringLiteral("Failover")).group(QStringLiteral("1"));
+    fallback.writeEntry(QStringLiteral("ApiKey"), QStringLiteral("test-key"));
+    fallback.writeEntry(QStringLiteral("Model"), QStringLiteral("gpt-4o-mini"));
+    const auto limited = llm::read_settings(config);
+    config->group(QStringLiteral("Failover")).deleteGroup();
+    group.deleteEntry(QStringLiteral("RequestsPerMinute"));
+    QCOMPARE(limited.fallbacks.size(), std::size_t(1));
+    QCOMPARE(limited.fallbacks.front().requests_per_minute, 60);
 }
 
 void c_test_llm_runner::test_empty_query()
@@ -76,7 +118,151 @@ void c_test_llm_runner::test_empty_query()
     QVERIFY(prompt.isEmpty());
 }
 
-void c_test_llm_runner::cleanup_test_case()
+void c_test_llm_runner::test_adaptive_debounce()
+{
+    using namespace std::chrono_literals;
+    llm::c_typing_cadence cadence(200ms, 1500ms, 800ms);
+
+    // Without enough samples the configured delay is used
+    QCOMPARE(cadence.delay(), 800ms);
+
+    // A steady 150 ms typist converges on the lower bound
+    auto now = llm::c_typing_cadence::t_clock::now();
+    for (int i = 0; i < 30; ++i)
+    {
+        cadence.record_keystroke(now);
+        now += 150ms;
+    }
+    QCOMPARE(cadence.delay(), 200ms);
+
+    // Thinking pauses longer than the upper bound are not cadence
+    const auto before = cadence.state();
+    cadence.record_keystroke(now + 10s);
+    QCOMPARE(cadence.state().samples, before.samples);
+
+    // Persisted state restores the same delay
+    llm::c_typing_cadence restored(200ms, 1500ms, 800ms);
+    restored.restore(cadence.state());
+    QCOMPARE(restored.delay(), cadence.delay());
+
+    // A slow typist gets a longer, but bounded, delay
+    llm::c_typing_cadence slow(200ms, 1500ms, 800ms);
+    now = llm::c_typing_cadence::t_clock::now();
+    for (int i = 0; i < 30; ++i)
+    {
+        slow.record_keystroke(now);
+        now += (i % 2 == 0) ? 500ms : 900ms;
+    }
+    QVERIFY(slow.delay() > 700ms);
+    QVERIFY(slow.delay() <= 1500ms);
+}
+
+void c_test_llm_runner::test_offline_providers()
+{
+    // Only servers on this machine stay reachable without a network
+    llm::s_config remote;
+    remote.apiKey = QStringLiteral("test-key");
+    remote.model = QStringLiteral("gpt-4");
+    llm::s_config local;
+    local.provider = llm::e_provider::Local;
+    local.model = QStringLiteral("llama3.2");
+    QVERIFY(llm::needs_network(remote));
+    QVERIFY(!llm::needs_network(local));
+    local.base_url = QStringLiteral("unix:///run/llm.sock");
+    QVERIFY(!llm::needs_network(local));
+    local.base_url = QStringLiteral("http://127.0.0.1:11434");
+    QVERIFY(!llm::needs_network(local));
+    local.base_url = QStringLiteral("http://gpu-box.lan:11434");
+    QVERIFY(llm::needs_network(local));
+
+    QVERIFY(llm::c_reachability::is_online(QNetworkInformation::Reachability::Online));
+    QVERIFY(llm::c_reachability::is_online(QNetworkInformation::Reachability::Unknown));
+    QVERIFY(!llm::c_reachability::is_online(QNetworkInformation::Reachability::Disconnected));
+
+    // Offline, the chain skips to the local fallback without creating any client
+    llm::c_provider_chain chain([]()
+                                { return std::shared_ptr<llm::c_connection_pool>(); });
+    chain.apply({ remote }, 3, std::chrono::seconds(30), std::nullopt);
+    QVERIFY(!chain.serves_offline());
+    QVERIFY(!chain.next_available(0, true));
+    local.base_url.clear();
+    chain.apply({ remote, local }, 3, std::chrono::seconds(30), std::nullopt);
+    QVERIFY(chain.serves_offline());
+    QCOMPARE(chain.next_available(0, true), std::optional<std::size_t>(1));
+    QCOMPARE(chain.next_available(), std::optional<std::size_t>(0));
+}
+
+void c_test_llm_runner::test_speculative_dispatch()
+{
+    using namespace std::chrono_literals;
+    llm::c_speculation speculation(2);
+
+    // Questions that read as finished
+    QVERIFY(speculation.looks_complete(QStringLiteral("what is the capital of France?")));
+    QVERIFY(!speculation.looks_complete(QStringLiteral("what is the capital of")));
+    QVERIFY(!speculation.looks_complete(QStringLiteral("define entropy")));
+
+    // The per-minute budget refills as old requests age out
+    auto now = llm::c_speculation::t_clock::now();
+    QVERIFY(speculation.try_acquire(now));
+    QVERIFY(speculation.try_acquire(now + 1s));
+    QVERIFY(!speculation.try_acquire(now + 2s));
+    QVERIFY(speculation.try_acquire(now + 61s));
+
+    speculation.set_limit(0);
+    QVERIFY(!speculation.looks_complete(QStringLiteral("what is the capital of France?")));
+}
+
+void c_test_llm_runner::test_query_routing()
+{
+    llm::c_router router;
+    QCOMPARE(router.classify(QStringLiteral("capital of peru")).tier, llm::e_tier::fast);
+    QCOMPARE(router.classify(QStringLiteral("how does a heat pump work in winter")).tier, llm::e_tier::balanced);
+    QCOMPARE(router.classify(QStringLiteral("refactor this function to avoid the copy")).tier, llm::e_tier::strong);
+    const auto code = router.classify(QStringLiteral("why is std::vector<bool>::at() slow"));
+    QCOMPARE(code.tier, llm::e_tier::strong);
+    QCOMPARE(code.reason, QLatin1StringView("code"));
+    QCOMPARE(router.classify(QStringLiteral("what does `git rebase` do")).reason, QLatin1StringView("code"));
+
+    // Topics and single hints are not tasks
+    QCOMPARE(router.classify(QStringLiteral("python version")).tier, llm::e_tier::fast);
+    QCOMPARE(router.classify(QStringLiteral("sql meaning")).tier, llm::e_tier::fast);
+    QCOMPARE(router.classify(QStringLiteral("what is f(x) at zero")).tier, llm::e_tier::fast);
+
+    // The user's rules come first; an invalid one is ignored
+    router.set_rules(QStringLiteral("^define "), QStringLiteral("("));
+    const auto ruled = router.classify(QStringLiteral("define entropy in thermodynamics and information theory"));
+    QCOMPARE(ruled.tier, llm::e_tier::fast);
+    QCOMPARE(ruled.reason, QLatin1StringView("rule"));
+    QCOMPARE(router.classify(QStringLiteral("capital of peru")).reason, QLatin1StringView("length"));
+
+    // Profiles sit after the failover list and fall back to the configured provider
+    llm::s_config remote;
+    remote.apiKey = QStringLiteral("test-key");
+    remote.model = QStringLiteral("gpt-4");
+    llm::s_config fast = remote;
+    fast.model = QStringLiteral("gpt-4o-mini");
+    llm::c_provider_chain chain([]()
+                                { return std::shared_ptr<llm::c_connection_pool>(); });
+    std::array<std::optional<llm::s_config>, llm::tier_count> profiles;
+    profiles[static_cast<std::size_t>(llm::e_tier::fast)] = fast;
+    chain.apply({ remote }, 3, std::chrono::seconds(30), std::nullopt, profiles);
+    QCOMPARE(chain.size(), std::size_t(2));
+    QCOMPARE(chain.profile(llm::e_tier::fast), std::optional<std::size_t>(1));
+    QVERIFY(!chain.profile(llm::e_tier::strong));
+    QVERIFY(!chain.profile(llm::e_tier::fast, true));
+    QCOMPARE(chain.next_fallback(1), std::optional<std::size_t>(0));
+    QVERIFY(!chain.next_fallback(0));
+    QVERIFY(!chain.next_available(1));
+
+    // Answers are cached under the model a question is routed to
+    QCOMPARE(chain.routed_config(llm::e_tier::fast).model, QStringLiteral("gpt-4o-mini"));
+    QCOMPARE(chain.routed_config(llm::e_tier::strong).model, QStringLiteral("gpt-4"));
+    QVERIFY(llm::c_response_cache::make_key(chain.routed_config(llm::e_tier::fast), QStringLiteral("capital of peru"))
+            != llm::c_response_cache::make_key(chain.routed_config(llm::e_tier::strong), QStringLiteral("capital of peru")));
+}
+
+void c_test_llm_runner::cleanupTestCase()
 {
     // Cleanup test config
     auto config = KSharedConfig::openConfig(QStringLiteral("krunnerllmrc-test"));
@@ -11,5 +11,6 @@ NC='\033[0m' # No Color
 
 echo -e "${GREEN}Uninstalling KRunner LLM Plugin${NC}"
 sudo cmake --build build --target uninstall
+pkill -x krunner-llm-daemon || true
 echo -e "${GREEN}Uninstallation complete${NC}"
 kquitapp6 krunner && krunner &